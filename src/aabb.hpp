@@ -0,0 +1,95 @@
+#pragma once
+#include "ray.hpp"
+
+// a class representing an axis-aligned bounding box
+class aabb {
+public:
+
+	interval x, y, z;				// extents of the box along each axis
+
+	// default constructor (an empty box)
+	aabb() { }
+
+	// constructor to initialise the box from an interval per axis
+	// parameters:
+	//   ix: extent along x
+	//   iy: extent along y
+	//   iz: extent along z
+	aabb(const interval &ix, const interval &iy, const interval &iz)
+		: x(ix), y(iy), z(iz) { }
+
+	// constructor to initialise the box from two opposite corner points
+	// parameters:
+	//   a: the first corner
+	//   b: the opposite corner
+	aabb(const point3 &a, const point3 &b)
+		: x(fmin(a[0], b[0]), fmax(a[0], b[0])),
+		  y(fmin(a[1], b[1]), fmax(a[1], b[1])),
+		  z(fmin(a[2], b[2]), fmax(a[2], b[2])) { }
+
+	// constructor to initialise the box tightly enclosing two boxes
+	// parameters:
+	//   box0: the first box
+	//   box1: the second box
+	aabb(const aabb &box0, const aabb &box1)
+		: x(box0.x, box1.x), y(box0.y, box1.y), z(box0.z, box1.z) { }
+
+	// return the extent of the box along an axis
+	// parameters:
+	//   n: axis index (0 = x, 1 = y, 2 = z)
+	const interval &axis(int n) const {
+		if (n == 1) return y;
+		if (n == 2) return z;
+		return x;
+	}
+
+	// return the index of the axis along which the box is largest
+	int longestAxis() const {
+		if (x.size() > y.size()) {
+			return x.size() > z.size() ? 0 : 2;
+		}
+		return y.size() > z.size() ? 1 : 2;
+	}
+
+	// return the centre point of the box
+	point3 centre() const {
+		return point3(0.5 * (x.min + x.max), 0.5 * (y.min + y.max), 0.5 * (z.min + z.max));
+	}
+
+	// return a copy of the box with no side thinner than delta (avoids degenerate slabs)
+	// parameters:
+	//   delta: minimum thickness of each side
+	aabb pad(double delta = 0.0001) const {
+		return aabb(x.size() >= delta ? x : x.expand(delta),
+					y.size() >= delta ? y : y.expand(delta),
+					z.size() >= delta ? z : z.expand(delta));
+	}
+
+	// check for ray / box intersection using the slab method
+	// parameters:
+	//   r: the ray
+	//   ray_t: an interval representing the range of intersection values
+	// returns:
+	//   true if the ray passes through the box within the interval
+	bool hit(const ray &r, interval ray_t) const {
+		auto origin = r.origin();
+		auto direction = r.direction();
+		// clip the interval against the slab on each axis in turn
+		for (int a = 0; a < 3; ++a) {
+			auto inverse_direction = 1 / direction[a];
+			auto t0 = (axis(a).min - origin[a]) * inverse_direction;
+			auto t1 = (axis(a).max - origin[a]) * inverse_direction;
+			if (inverse_direction < 0) {
+				std::swap(t0, t1);
+			}
+			if (t0 > ray_t.min) ray_t.min = t0;
+			if (t1 < ray_t.max) ray_t.max = t1;
+			// interval became empty, ray misses the box
+			if (ray_t.max <= ray_t.min) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+};
@@ -0,0 +1,440 @@
+#pragma once
+#include "bvh.hpp"
+#include "camera.hpp"
+#include "compact_spheres.hpp"
+#include "mesh_loader.hpp"
+#include "numa_scene.hpp"
+#include <chrono>
+#include <cstdio>
+#include <unordered_set>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// a class counting the hardware cache misses of the calling thread, where the kernel allows it
+class cache_miss_counter {
+public:
+
+	// constructor to open the counter (stopped)
+	cache_miss_counter() {
+#ifdef __linux__
+		perf_event_attr attributes{};
+		attributes.type = PERF_TYPE_HARDWARE;
+		attributes.size = sizeof(attributes);
+		attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+		attributes.disabled = 1;
+		attributes.exclude_kernel = 1;
+		attributes.exclude_hv = 1;
+		_fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+#endif
+	}
+
+	cache_miss_counter(const cache_miss_counter &) = delete;
+	cache_miss_counter &operator=(const cache_miss_counter &) = delete;
+
+	// destructor to close the counter
+	~cache_miss_counter() {
+#ifdef __linux__
+		if (_fd >= 0) {
+			close(_fd);
+		}
+#endif
+	}
+
+	// return true if cache misses can be counted
+	bool available() const { return _fd >= 0; }
+
+	// reset the count and start counting
+	void start() {
+#ifdef __linux__
+		if (_fd >= 0) {
+			ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	// stop counting
+	// returns:
+	//   the cache misses since start
+	uint64_t stop() {
+		uint64_t count = 0;
+#ifdef __linux__
+		if (_fd >= 0) {
+			ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(_fd, &count, sizeof(count)) != sizeof(count)) {
+				count = 0;
+			}
+		}
+#endif
+		return count;
+	}
+
+private:
+
+	int _fd = -1;							// perf event file descriptor, or -1 if unavailable
+
+};
+
+// time a render, discarding the image
+// parameters:
+//   settings: the camera to render with
+//   world: the specified hittable world
+//   repeats: number of timed renders
+// returns:
+//   the fastest render time in seconds
+inline double timeRender(camera settings, const hittable &world, int repeats = 5) {
+	settings.log_progress = false;
+	std::ostream discard(nullptr);
+	auto fastest = infinity;
+	for (int r = 0; r < repeats; ++r) {
+		auto start = std::chrono::steady_clock::now();
+		settings.render(world, discard);
+		auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		fastest = fmin(fastest, elapsed);
+	}
+	return fastest;
+}
+
+// check that the mesh loader rejects malformed obj files and still loads a well-formed one
+// parameters:
+//   prefix: the test files are written to <prefix>_check.obj
+// returns:
+//   true if every file was handled as expected
+inline bool checkMeshLoading(const std::string &prefix) {
+	struct test_case {
+		const char *name;
+		const char *body;
+		bool valid;
+	};
+	const test_case cases[] = {
+		{ "well-formed", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2/5/7 -1 # comment\n", true },
+		{ "face index 0", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 0 1 2\n", false },
+		{ "unparsable face index", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 x 3\n", false },
+		{ "trailing text in face index", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2a 3\n", false },
+		{ "short vertex", "v 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\n", false },
+	};
+	auto path = prefix + "_check.obj";
+	auto passed = true;
+	for (const auto &c : cases) {
+		{
+			std::ofstream file(path, std::ios::binary);
+			file << c.body;
+		}
+		std::string outcome = "loaded";
+		try {
+			mesh_loader::load(path, nullptr);
+		} catch (const std::exception &e) {
+			outcome = e.what();
+		}
+		auto ok = (outcome == "loaded") == c.valid;
+		passed = passed && ok;
+		std::printf("%-28s %-24s %s\n", c.name, outcome.c_str(), ok ? "ok" : "FAILED");
+	}
+	std::remove(path.c_str());
+	return passed;
+}
+
+// write a unit sphere tessellated into quads as an obj file and a binary ply file, then time loading each
+// on one thread and on every hardware thread
+// parameters:
+//   prefix: the files are written to <prefix>.obj and <prefix>.ply
+//   segments: the number of segments around the sphere (there are half as many rings)
+//   repeats: number of timed loads
+inline void benchmarkMeshLoading(const std::string &prefix, int segments, int repeats = 3) {
+	auto rings = std::max(2, segments / 2);
+	auto vertex_count = static_cast<size_t>(segments + 1) * (rings + 1);
+	auto face_count = static_cast<size_t>(segments) * rings;
+	// the vertex of a grid point, row by row from the lower pole
+	std::vector<float> positions;
+	positions.reserve(3 * vertex_count);
+	for (int ring = 0; ring <= rings; ++ring) {
+		auto theta = std::numbers::pi * ring / rings;
+		for (int segment = 0; segment <= segments; ++segment) {
+			auto phi = 2 * std::numbers::pi * segment / segments;
+			positions.push_back(static_cast<float>(sin(theta) * cos(phi)));
+			positions.push_back(static_cast<float>(-cos(theta)));
+			positions.push_back(static_cast<float>(sin(theta) * sin(phi)));
+		}
+	}
+	// the corners of a quad, counter-clockwise seen from outside
+	auto corners = [&](size_t face, uint32_t (&quad)[4]) {
+		auto ring = static_cast<uint32_t>(face / segments), segment = static_cast<uint32_t>(face % segments);
+		auto row = static_cast<uint32_t>(segments + 1);
+		quad[0] = ring * row + segment;
+		quad[1] = (ring + 1) * row + segment;
+		quad[2] = (ring + 1) * row + segment + 1;
+		quad[3] = ring * row + segment + 1;
+	};
+	// obj text, 1-based indices
+	{
+		std::ofstream obj(prefix + ".obj");
+		char line[128];
+		for (size_t v = 0; v < vertex_count; ++v) {
+			obj.write(line, std::snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", positions[3 * v], positions[3 * v + 1], positions[3 * v + 2]));
+		}
+		for (size_t f = 0; f < face_count; ++f) {
+			uint32_t quad[4];
+			corners(f, quad);
+			obj.write(line, std::snprintf(line, sizeof(line), "f %u %u %u %u\n", quad[0] + 1, quad[1] + 1, quad[2] + 1, quad[3] + 1));
+		}
+	}
+	// binary ply, in host byte order
+	{
+		std::ofstream ply(prefix + ".ply", std::ios::binary);
+		ply << "ply\nformat " << (std::endian::native == std::endian::little ? "binary_little_endian" : "binary_big_endian")
+			<< " 1.0\nelement vertex " << vertex_count << "\nproperty float x\nproperty float y\nproperty float z\n"
+			<< "element face " << face_count << "\nproperty list uchar uint vertex_indices\nend_header\n";
+		ply.write(reinterpret_cast<const char *>(positions.data()), positions.size() * sizeof(float));
+		for (size_t f = 0; f < face_count; ++f) {
+			unsigned char count = 4;
+			uint32_t quad[4];
+			corners(f, quad);
+			ply.write(reinterpret_cast<const char *>(&count), 1);
+			ply.write(reinterpret_cast<const char *>(quad), sizeof(quad));
+		}
+	}
+	// time each format at each thread count
+	auto hardware_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::printf("%zu vertices, %zu triangles\n", vertex_count, 2 * face_count);
+	std::printf("%-6s %8s %10s %12s %10s %10s\n", "format", "threads", "size (MB)", "triangles", "time (s)", "MB/s");
+	for (const auto &extension : { ".obj", ".ply" }) {
+		auto path = prefix + extension;
+		double megabytes = mapped_file(path).size() / 1048576.0;
+		for (auto threads : { 1u, hardware_threads }) {
+			// time the load including the mesh hierarchy build
+			auto fastest = infinity;
+			size_t triangles = 0;
+			for (int r = 0; r < repeats; ++r) {
+				auto start = std::chrono::steady_clock::now();
+				auto mesh = mesh_loader::load(path, nullptr, false, threads);
+				fastest = fmin(fastest, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+				triangles = mesh->triangleCount();
+			}
+			std::printf("%-6s %8u %10.1f %12zu %10.3f %10.1f\n", extension + 1, threads, megabytes, triangles, fastest,
+						megabytes / fastest);
+			if (hardware_threads == 1) {
+				break;
+			}
+		}
+	}
+}
+
+// return the relative mean squared error of a frame's colour against a reference
+// (each squared difference is divided by the squared reference value plus 0.01, so dark pixels do not dominate)
+inline double relativeMse(const frame_buffer &frame, const frame_buffer &reference) {
+	auto sum = 0.0;
+	for (size_t i = 0; i < frame.pixels.size(); ++i) {
+		for (int c = 0; c < 3; ++c) {
+			auto difference = frame.pixels[i][c] - reference.pixels[i][c];
+			sum += difference * difference / (reference.pixels[i][c] * reference.pixels[i][c] + 0.01);
+		}
+	}
+	return sum / (3.0 * frame.pixels.size());
+}
+
+// measure the denoiser against a high sample count reference at several sample counts
+// parameters:
+//   world: the specified hittable world
+//   settings: the base camera (image size and denoiser settings are used as given)
+//   sample_counts: the sample counts to denoise
+//   reference_samples: samples per pixel of the reference
+// returns:
+//   true if denoising lowered the error at every sample count
+inline bool benchmarkDenoiser(const hittable &world, camera settings, const std::vector<int> &sample_counts,
+							  int reference_samples = 512) {
+	// render with feature buffers but no filter passes, then filter a copy
+	auto denoiser_settings = settings.denoiser_settings;
+	settings.denoise = true;
+	settings.denoiser_settings.iterations = 0;
+	settings.feature_prefix.clear();
+	settings.log_progress = false;
+	settings.samples_per_pixel = reference_samples;
+	auto reference = settings.renderImage(world);
+	std::printf("%8s %14s %14s %10s\n", "samples", "noisy", "denoised", "change");
+	auto improved = true;
+	for (auto samples : sample_counts) {
+		settings.samples_per_pixel = samples;
+		auto noisy = settings.renderImage(world);
+		auto denoised = noisy;
+		denoiser_settings.filter(denoised, settings.thread_count);
+		auto before = relativeMse(noisy, reference);
+		auto after = relativeMse(denoised, reference);
+		improved = improved && after < before;
+		std::printf("%8d %14.5f %14.5f %9.1f%%\n", samples, before, after, 100.0 * (after - before) / before);
+	}
+	return improved;
+}
+
+// compare rendering one shared scene on unpinned threads with rendering per-node replicas on pinned threads,
+// reporting the throughput of each node
+// parameters:
+//   build: builds the scene (called once for the shared copy and once per node for the replicas)
+//   settings: the base camera (image size and sample count are used as given)
+//   topology: the numa nodes to render across
+inline void benchmarkNuma(const std::function<shared_ptr<hittable>()> &build, camera settings,
+						  const numa_topology &topology, int repeats = 3) {
+	auto seed = std::random_device{}();
+	// shared scene, built on the calling thread
+	randomGenerator().seed(seed);
+	auto shared = build();
+	settings.numa = nullptr;
+	auto unpinned = timeRender(settings, *shared, repeats);
+	// replicated scene, keeping the per-node results of the fastest render
+	numa_scene replicas(topology, build, seed);
+	settings.numa = &topology;
+	settings.log_progress = false;
+	std::ostream discard(nullptr);
+	auto pinned = infinity;
+	std::vector<numa_node_stats> fastest;
+	for (int r = 0; r < repeats; ++r) {
+		std::vector<numa_node_stats> stats;
+		settings.numa_stats = &stats;
+		auto start = std::chrono::steady_clock::now();
+		settings.render(replicas, discard);
+		auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (elapsed < pinned) {
+			pinned = elapsed;
+			fastest = stats;
+		}
+	}
+	std::printf("shared scene, unpinned   %9.3f s\n", unpinned);
+	std::printf("node replicas, pinned    %9.3f s  %8.2fx\n", pinned, unpinned / pinned);
+	// per-node throughput
+	auto samples_per_row = static_cast<double>(settings.image_width) * settings.samples_per_pixel;
+	std::printf("%-6s %6s %8s %8s %10s %14s\n", "node", "cpus", "rows", "stolen", "time (s)", "samples/s");
+	for (size_t node = 0; node < fastest.size(); ++node) {
+		const auto &stats = fastest[node];
+		auto rate = stats.seconds > 0 ? stats.items * samples_per_row / stats.seconds : 0.0;
+		std::printf("%-6zu %6zu %8zu %8zu %10.3f %14.0f\n", node, topology.cpus(node).size(), stats.items, stats.stolen,
+					stats.seconds, rate);
+	}
+}
+
+// compare path guiding with the plain integrator at equal render time, measuring the error of each against a
+// high sample count reference
+// parameters:
+//   world: the specified hittable world
+//   settings: the base camera (the guided render uses its sample count)
+//   reference_samples: samples per pixel of the reference render
+inline void compareGuiding(const hittable &world, camera settings, int reference_samples) {
+	settings.log_progress = false;
+	settings.denoise = false;
+	settings.feature_prefix.clear();
+	// render with a camera, returning the frame and the render time
+	auto timed = [&](camera c) {
+		auto start = std::chrono::steady_clock::now();
+		auto frame = c.renderImage(world);
+		return std::make_pair(frame, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	};
+	// relative mean squared error against the reference
+	auto reference_settings = settings;
+	reference_settings.path_guiding = false;
+	reference_settings.samples_per_pixel = reference_samples;
+	auto reference = timed(reference_settings).first;
+	auto error = [&](const frame_buffer &frame) {
+		auto sum = 0.0;
+		for (size_t p = 0; p < frame.pixels.size(); ++p) {
+			for (int c = 0; c < 3; ++c) {
+				auto difference = frame.pixels[p][c] - reference.pixels[p][c];
+				sum += difference * difference / (reference.pixels[p][c] * reference.pixels[p][c] + 0.01);
+			}
+		}
+		return sum / (3.0 * frame.pixels.size());
+	};
+	// guided render
+	auto guided_settings = settings;
+	guided_settings.path_guiding = true;
+	auto guided = timed(guided_settings);
+	// plain render, with the sample count scaled to take the same time
+	auto plain_settings = settings;
+	plain_settings.path_guiding = false;
+	auto trial = timed(plain_settings);
+	plain_settings.samples_per_pixel = std::max(1, static_cast<int>(std::lround(settings.samples_per_pixel * guided.second / trial.second)));
+	auto plain = timed(plain_settings);
+	std::printf("%-10s %8s %10s %14s\n", "integrator", "spp", "time (s)", "relative mse");
+	std::printf("%-10s %8d %10.3f %14.6f\n", "plain", plain_settings.samples_per_pixel, plain.second, error(plain.first));
+	std::printf("%-10s %8d %10.3f %14.6f\n", "guided", guided_settings.samples_per_pixel, guided.second, error(guided.first));
+}
+
+// compare the scene layout of sphere objects under a bvh_node with compact_spheres using 32-bit and (where the
+// distinct materials fit) 16-bit material indices, reporting memory per sphere, ray throughput, cache misses and
+// render time
+// parameters:
+//   objects: the spheres of the scene
+//   settings: the camera to time renders with
+//   rays: number of random rays traced through each layout on one thread
+inline void benchmarkCompactScene(const std::vector<shared_ptr<hittable>> &objects, camera settings, int rays = 1000000) {
+	// today's layout: a heap object per sphere and per material, and a bvh_node per pair of objects
+	hittable_list list;
+	for (const auto &object : objects) {
+		list.add(object);
+	}
+	auto objects_layout = make_shared<bvh_node>(list);
+	std::unordered_set<const material *> materials;
+	size_t objects_bytes = objects.size() * (sizeof(shared_ptr<hittable>) + sizeof(sphere) + 16) +
+						   (objects.size() - 1) * (sizeof(bvh_node) + 16);
+	size_t objects_material_bytes = 0;
+	for (const auto &object : objects) {
+		auto m = std::static_pointer_cast<sphere>(object)->surface();
+		if (materials.insert(m.get()).second) {
+			objects_material_bytes += material_table::materialBytes(*m);
+		}
+	}
+	// compact layouts, each with its own material table
+	auto table32 = make_shared<material_table>();
+	auto compact32 = make_shared<compact_spheres<uint32_t>>(objects, table32);
+	auto table16 = make_shared<material_table>();
+	shared_ptr<compact_spheres<uint16_t>> compact16;
+	if (table32->size() <= 65536) {
+		compact16 = make_shared<compact_spheres<uint16_t>>(objects, table16);
+	}
+	std::printf("%zu spheres, %zu material objects, %zu distinct after interning\n\n", objects.size(), materials.size(),
+				table32->size());
+	// the same random rays for every layout, starting among the spheres
+	auto box = objects_layout->boundingBox();
+	std::vector<ray> tests;
+	tests.reserve(rays);
+	for (int i = 0; i < rays; ++i) {
+		point3 origin(randomDouble(fmax(box.x.min, -50.0), fmin(box.x.max, 50.0)), randomDouble(0.1, 4),
+					  randomDouble(fmax(box.z.min, -50.0), fmin(box.z.max, 50.0)));
+		tests.emplace_back(origin, randomUnitVector(), randomDouble());
+	}
+	std::vector<double> reference(rays);
+	cache_miss_counter counter;
+	std::printf("%-16s %13s %13s %12s %11s %11s %11s %7s\n", "layout", "geometry", "materials", "total", "rays/s",
+				"misses/ray", "render (s)", "differ");
+	std::printf("%-16s %13s %13s %12s\n", "", "(B/sphere)", "(B/sphere)", "(MB)");
+	auto report = [&](const char *name, const hittable &world, size_t bytes, size_t material_bytes, bool record) {
+		hit_record rec;
+		size_t differ = 0;
+		counter.start();
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < rays; ++i) {
+			auto distance = world.hit(tests[i], interval(0.001, infinity), rec) ? rec.distance : infinity;
+			if (record) {
+				reference[i] = distance;
+			} else if (fabs(distance - reference[i]) > 1e-4 * fmax(1.0, reference[i]) && distance != reference[i]) {
+				++differ;
+			}
+		}
+		auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		auto misses = counter.stop();
+		auto render = timeRender(settings, world, 1);
+		char miss_text[32] = "n/a";
+		if (counter.available()) {
+			std::snprintf(miss_text, sizeof(miss_text), "%.2f", static_cast<double>(misses) / rays);
+		}
+		std::printf("%-16s %13.1f %13.1f %12.2f %11.0f %11s %11.3f %7zu\n", name, static_cast<double>(bytes) / objects.size(),
+					static_cast<double>(material_bytes) / objects.size(), (bytes + material_bytes) / 1048576.0,
+					rays / elapsed, miss_text, render, differ);
+	};
+	report("objects + bvh", *objects_layout, objects_bytes, objects_material_bytes, true);
+	report("compact, 32-bit", *compact32, compact32->bytes(), table32->bytes(), false);
+	if (compact16 != nullptr) {
+		report("compact, 16-bit", *compact16, compact16->bytes(), table16->bytes(), false);
+	}
+}
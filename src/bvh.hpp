@@ -0,0 +1,76 @@
+#pragma once
+#include "hittable_list.hpp"
+#include <algorithm>
+
+// a class representing a node of a bounding volume hierarchy, used to accelerate ray / scene intersection
+// (moving objects report the box swept over the shutter interval, so a single hierarchy serves every ray time)
+class bvh_node : public hittable {
+public:
+
+	// constructor to build a hierarchy over every object in a list
+	// parameters:
+	//   list: the list of objects (copied, the list itself is left unchanged)
+	bvh_node(hittable_list list)
+		: bvh_node(list.objects, 0, list.objects.size()) { }
+
+	// constructor to build a hierarchy over a range of objects
+	// parameters:
+	//   objects: the objects (reordered in place while building)
+	//   start: index of the first object in the range
+	//   end: index one past the last object in the range
+	bvh_node(std::vector<shared_ptr<hittable>> &objects, size_t start, size_t end) {
+		// calculate box enclosing the range to pick a split axis
+		for (size_t i = start; i < end; ++i) {
+			_bbox = aabb(_bbox, objects[i]->boundingBox());
+		}
+		auto axis = _bbox.longestAxis();
+		auto span = end - start;
+
+		if (span == 1) {
+			// single object, both children refer to it
+			_left = _right = objects[start];
+		} else if (span == 2) {
+			// two objects, one child each
+			_left = objects[start];
+			_right = objects[start + 1];
+		} else {
+			// partition objects about the median box centre along the split axis
+			auto mid = start + span / 2;
+			std::nth_element(objects.begin() + start, objects.begin() + mid, objects.begin() + end,
+				[axis](const shared_ptr<hittable> &a, const shared_ptr<hittable> &b) {
+					return a->boundingBox().centre()[axis] < b->boundingBox().centre()[axis];
+				});
+			_left = make_shared<bvh_node>(objects, start, mid);
+			_right = make_shared<bvh_node>(objects, mid, end);
+		}
+	}
+
+	// check for intersections with the objects beneath this node
+	// parameters:
+	//   r: the ray
+	//	 ray_t: an interval representing the range of intersection values
+	//   rec: the record containing intersection information
+	// returns:
+	//   true if an intersection matched else false
+	bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+		// skip the whole subtree if the ray misses its box
+		if (!_bbox.hit(r, ray_t)) {
+			return false;
+		}
+		// check left child, then shorten the interval so the right child only reports closer hits
+		auto hit_left = _left->hit(r, ray_t, rec);
+		auto hit_right = _right != _left && _right->hit(r, interval(ray_t.min, hit_left ? rec.distance : ray_t.max), rec);
+		// intersection matched
+		return hit_left || hit_right;
+	}
+
+	// return the box enclosing every object beneath this node
+	aabb boundingBox() const override { return _bbox; }
+
+private:
+
+	shared_ptr<hittable> _left;				// left child
+	shared_ptr<hittable> _right;			// right child
+	aabb _bbox;								// box enclosing both children
+
+};
@@ -1,8 +1,24 @@
 #pragma once
 #include "colour.hpp"
+#include "denoiser.hpp"
+#include "lambertian.hpp"
 #include "material.hpp"
+#include "numa.hpp"
+#include "sd_tree.hpp"
+#include "parallel.hpp"
+#include "render_cache.hpp"
 #include "sphere.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
 
 // a class representing a camera used to render a scene
 class camera {
@@ -18,37 +34,173 @@ public:
 	vec3 v_up = vec3(0, 1, 0);					// camera-relative 'up' direction
 	double defocus_angle = 0;					// variation angle of rays through each pixel
 	double focus_distance = 10;					// distance from camera 'from point' to plane of focus
+	double shutter_open = 0;					// time the shutter opens (moving objects are at their start at time 0)
+	double shutter_close = 0;					// time the shutter closes (equal to shutter_open disables motion blur)
+												// (both are clamped to [0, 1], the times bounding boxes cover)
+	unsigned thread_count = 0;					// number of render threads (0 uses every hardware thread)
+	bool denoise = false;						// apply the edge-aware denoiser to the final colour
+	denoiser denoiser_settings;					// denoiser parameters
+	std::string feature_prefix;					// if set, write albedo / normal / depth buffers to <prefix>_*.ppm
+	bool log_progress = true;					// write progress to std::clog
+	size_t memory_budget = size_t(256) << 20;	// bytes of pixel data held at once by renderToFile
+	const numa_topology *numa = nullptr;		// if set, pin render threads to cpus and hand out rows node by node
+	std::vector<numa_node_stats> *numa_stats = nullptr;	// if set (with numa), receives the rows rendered by each node
+	bool path_guiding = false;					// learn where light arrives from in early passes and sample towards it
+	int guiding_training_passes = 4;			// most passes (of 1, 2, 4, ... samples) recording light, using at most half the samples
+	double guiding_fraction = 0.5;				// share of diffuse bounces sampled from the learned distribution
+	double exposure = 1.0;						// scale applied to the final linear colour when writing
 
 	// render the scene
 	// parameters:
 	//   world: the specified hittable world
-	void render(const hittable& world) {
+	//   out: the output stream receiving the image
+	//   cancelled: if not null, polled between rows, the render stops without writing an image once it is set
+	// returns:
+	//   true if the image was written, false if the render was cancelled
+	bool render(const hittable& world, std::ostream &out = std::cout, const std::atomic<bool> *cancelled = nullptr) {
+		// render the final colours
+		auto frame = renderImage(world, cancelled);
+		if (frame.pixels.empty()) {
+			return false;
+		}
+		// image header (.ppm format)
+		out << "P3\n"
+			<< image_width << " " << _image_height << "\n255\n";
+		// write colours (already averaged over samples)
+		for (const auto &pixel_colour : frame.pixels) {
+			writeColour(out, exposure * pixel_colour, 1);
+		}
+		// log completion
+		if (log_progress) {
+			std::clog << "\rRender complete                     \n";
+		}
+		return true;
+	}
+
+	// render the scene into a frame of linear colours, writing feature buffers and denoising if enabled
+	// parameters:
+	//   world: the specified hittable world
+	//   cancelled: if not null, polled between rows, the render stops once it is set
+	// returns:
+	//   the frame, or an empty frame if the render was cancelled
+	frame_buffer renderImage(const hittable& world, const std::atomic<bool> *cancelled = nullptr) {
 		// initialise camera parameters
 		initialise();
+		// render every pixel, gathering feature buffers if they are used
+		auto frame = renderFrame(world, denoise || !feature_prefix.empty(), cancelled);
+		if (cancelled != nullptr && *cancelled) {
+			if (log_progress) {
+				std::clog << "\rRender cancelled                    \n";
+			}
+			return frame_buffer(0, 0, false);
+		}
+		// write feature buffers and filter the colour
+		if (!feature_prefix.empty()) {
+			frame.writeFeatures(feature_prefix);
+		}
+		if (denoise) {
+			if (log_progress) {
+				std::clog << "\rDenoising                           " << std::flush;
+			}
+			denoiser_settings.filter(frame, thread_count);
+		}
+		return frame;
+	}
+
+	// render the scene in horizontal bands written straight to a binary (.ppm p6) file, so the pixel data held
+	// at once stays within memory_budget whatever the image size; each band is written on a background thread
+	// while the next renders (denoising and feature buffers need the whole frame, so they are not applied)
+	// parameters:
+	//   world: the specified hittable world
+	//   path: the output image path
+	//   cancelled: if not null, polled between rows, the render stops and removes the file once it is set
+	// returns:
+	//   true if the image was written, false if the render was cancelled or the file could not be written
+	bool renderToFile(const hittable& world, const std::string &path, const std::atomic<bool> *cancelled = nullptr) {
+		// initialise camera parameters
+		initialise();
+		std::ofstream out(path, std::ios::binary);
 		// image header (.ppm format)
-		std::cout << "P3\n"
-				  << image_width << " " << _image_height << "\n255\n";
-		// loop through pixels
-		for (int j = 0; j < _image_height; ++j) {
-			// log progress
-			std::clog << "\rScanlines remaining: " << (_image_height - j) << " " << std::flush;
-			// loop through pixels
-			for (int i = 0; i < image_width; ++i) {
-				// calculate pixel colour by accumulating samples
-				colour pixel_colour(0, 0, 0);
-				// loop through samples
-				for (int sample = 0; sample < samples_per_pixel; ++sample) {
-					// get camera ray for the pixel
-					auto r = getRay(i, j);
-					// set colour
-					pixel_colour += rayColour(r, ray_depth, world);
-				}
-				// write colour
-				writeColour(std::cout, pixel_colour, samples_per_pixel);
+		out << "P6\n"
+			<< image_width << " " << _image_height << "\n255\n";
+		// size bands so the band being rendered and two finished bands (one being written) fit the budget
+		auto bytes_per_row = static_cast<size_t>(image_width) * (sizeof(colour) + 2 * 3);
+		auto band_rows = static_cast<int>(std::clamp<size_t>(memory_budget / bytes_per_row, 1, _image_height));
+		// one guide for the whole render, trained by the first band and sampled by every band
+		auto guide = path_guiding ? std::make_unique<path_guide>(world.boundingBox()) : nullptr;
+		// write of the previous band, at most one in flight
+		std::future<bool> pending;
+		auto written = static_cast<bool>(out);
+		for (int first_row = 0; written && first_row < _image_height; first_row += band_rows) {
+			auto row_count = std::min(band_rows, _image_height - first_row);
+			auto band = renderBand(world, false, first_row, row_count, cancelled, guide.get());
+			if (cancelled != nullptr && *cancelled) {
+				written = false;
+				break;
+			}
+			// finalise the band with gamma correction and quantisation
+			std::vector<unsigned char> bytes(band.pixels.size() * 3);
+			for (size_t i = 0; i < band.pixels.size(); ++i) {
+				quantiseColour(exposure * band.pixels[i], 1, &bytes[3 * i]);
 			}
+			// wait for the previous band, then write this one in the background
+			written = !pending.valid() || pending.get();
+			pending = std::async(std::launch::async, [&out, bytes = std::move(bytes)] {
+				out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+				return static_cast<bool>(out);
+			});
+		}
+		// wait for the last band
+		written = (!pending.valid() || pending.get()) && written && static_cast<bool>(out.flush());
+		out.close();
+		if (!written) {
+			std::remove(path.c_str());
 		}
 		// log completion
-		std::clog << "\rRender complete                     \n";
+		if (log_progress) {
+			std::clog << (written ? "\rRender complete                     \n" : "\rRender stopped                      \n");
+		}
+		return written;
+	}
+
+	// render the scene into a cache that records the materials each pixel's paths touch (see render_cache)
+	// (pixels are traced as by render, including across numa nodes; path guiding is rejected)
+	// parameters:
+	//   world: the specified hittable world
+	// returns:
+	//   the cache
+	render_cache renderCached(const hittable& world) {
+		// guided paths depend on a guide learned from the whole image, so re-rendering some pixels would not match
+		if (path_guiding) {
+			throw std::invalid_argument("incremental rendering does not support path guiding");
+		}
+		// initialise camera parameters
+		initialise();
+		render_cache cache(image_width, _image_height);
+		std::vector<size_t> every_pixel(cache.pixels.size());
+		std::iota(every_pixel.begin(), every_pixel.end(), 0);
+		renderPixels(world, cache, every_pixel);
+		return cache;
+	}
+
+	// bring a cache up to date after materials were edited in place, re-rendering only the pixels whose paths
+	// touched them (the camera must be otherwise unchanged since the cache was rendered)
+	// parameters:
+	//   world: the specified hittable world
+	//   cache: the cache, updated in place
+	//   changed: the edited materials
+	// returns:
+	//   the number of pixels re-rendered
+	size_t rerenderCached(const hittable& world, render_cache &cache, const std::vector<const material *> &changed) {
+		// guided paths depend on a guide learned from the whole image, so re-rendering some pixels would not match
+		if (path_guiding) {
+			throw std::invalid_argument("incremental rendering does not support path guiding");
+		}
+		// initialise camera parameters
+		initialise();
+		auto affected = cache.affectedPixels(changed);
+		renderPixels(world, cache, affected);
+		return affected.size();
 	}
 
 private:
@@ -61,6 +213,288 @@ private:
 	vec3 _u, _v, _w;							// camera frame basis vectors
 	vec3 _defocus_disk_u;						// defocus disk horizontal radius
 	vec3 _defocus_disk_v;						// defocus disk vertical radius
+	double _shutter_open;						// shutter open time, clamped to [0, 1]
+	double _shutter_close;						// shutter close time, clamped to [_shutter_open, 1]
+
+	// surface properties at the first hit of a camera ray, used for the feature buffers
+	struct first_hit {
+		colour albedo;							// surface albedo (background colour if the ray escaped)
+		vec3 normal;							// shading normal (zero if the ray escaped)
+		double depth = 0;						// distance along the ray (zero if the ray escaped)
+	};
+
+	// the learned guide of a render, shared by all of its bands
+	struct path_guide {
+		sd_tree tree;							// learned distribution of light
+		int training_passes = 0;				// passes recorded into the tree so far
+
+		path_guide(const aabb &bounds) : tree(bounds) { }
+	};
+
+	// render every pixel into a frame
+	// parameters:
+	//   world: the specified hittable world
+	//   features: also gather the feature buffers and noise estimate
+	//   cancelled: if not null, remaining rows are skipped once it is set
+	// returns:
+	//   the frame
+	frame_buffer renderFrame(const hittable& world, bool features, const std::atomic<bool> *cancelled = nullptr) const {
+		auto guide = path_guiding ? std::make_unique<path_guide>(world.boundingBox()) : nullptr;
+		return renderBand(world, features, 0, _image_height, cancelled, guide.get());
+	}
+
+	// render a band of rows into a frame
+	// parameters:
+	//   world: the specified hittable world
+	//   features: also gather the feature buffers and noise estimate
+	//   first_row: the first image row of the band
+	//   row_count: the number of rows in the band
+	//   cancelled: if not null, remaining rows are skipped once it is set
+	//   guide: the render's guide (required if path_guiding is set)
+	// returns:
+	//   a frame holding just the band
+	frame_buffer renderBand(const hittable& world, bool features, int first_row, int row_count,
+							const std::atomic<bool> *cancelled, path_guide *guide) const {
+		if (path_guiding) {
+			return renderGuided(world, features, first_row, row_count, cancelled, *guide);
+		}
+		auto sample = [&](int i, int j, first_hit *hit) { return rayColour(getRay(i, j), ray_depth, world, hit); };
+		return features ? renderRows<true>(first_row, row_count, cancelled, sample)
+						: renderRows<false>(first_row, row_count, cancelled, sample);
+	}
+
+	// render a band of rows in progressive passes of 1, 2, 4, ... samples, the early passes recording the light
+	// reaching each diffuse bounce into the render's sd_tree and every later pass sampling diffuse bounces from it
+	// (the guide only changes between passes and diffuse bounces still sample the lambertian lobe too, weighted by
+	// the combined density, so every pass is unbiased and all the samples are averaged into the frame; training
+	// passes are counted across the render, so once the first band has trained the guide later bands only sample it)
+	// parameters:
+	//   world: the specified hittable world
+	//   features: also gather the feature buffers and noise estimate
+	//   first_row, row_count: the band of rows to render
+	//   cancelled: if not null, remaining rows are skipped once it is set
+	//   guide: the render's guide, trained further while it has had fewer than guiding_training_passes passes
+	// returns:
+	//   a frame holding just the band
+	frame_buffer renderGuided(const hittable& world, bool features, int first_row, int row_count,
+							  const std::atomic<bool> *cancelled, path_guide &guide) const {
+		frame_buffer frame(image_width, row_count, features);
+		auto pass = *this;
+		int done = 0;
+		for (int pass_samples = 1; done < samples_per_pixel; pass_samples *= 2) {
+			if (cancelled != nullptr && *cancelled) {
+				break;
+			}
+			// train while the passes fit in half the samples, then spend the rest in one guided pass
+			auto training = guide.training_passes < guiding_training_passes && done + pass_samples <= samples_per_pixel / 2;
+			pass.samples_per_pixel = training ? pass_samples : samples_per_pixel - done;
+			auto sample = [&](int i, int j, first_hit *hit) {
+				return traceGuided(getRay(i, j), world, hit, guide.tree, training);
+			};
+			auto result = features ? pass.renderRows<true>(first_row, row_count, cancelled, sample)
+								   : pass.renderRows<false>(first_row, row_count, cancelled, sample);
+			// add the pass to the frame, weighted by its share of the samples
+			auto weight = static_cast<double>(pass.samples_per_pixel) / samples_per_pixel;
+			for (size_t p = 0; p < frame.pixels.size(); ++p) {
+				frame.pixels[p] += weight * result.pixels[p];
+				if (features) {
+					frame.albedo[p] += weight * result.albedo[p];
+					frame.normal[p] += weight * result.normal[p];
+					frame.depth[p] += weight * result.depth[p];
+					frame.variance[p] += weight * weight * result.variance[p];
+				}
+			}
+			done += pass.samples_per_pixel;
+			if (training) {
+				guide.tree.refine();
+				++guide.training_passes;
+			}
+		}
+		if (features) {
+			for (auto &n : frame.normal) {
+				n = n.nearZero() ? n : unitVector(n);
+			}
+		}
+		return frame;
+	}
+
+	// render a band of rows into a frame, rows shared between threads
+	// parameters:
+	//   first_row, row_count: the band of rows to render
+	//   cancelled: if not null, remaining rows are skipped once it is set
+	//   sample: called with the pixel and an optional first hit record, returns the colour of one sample
+	// returns:
+	//   a frame holding just the band
+	template <bool Features, typename SampleFunction>
+	frame_buffer renderRows(int first_row, int row_count, const std::atomic<bool> *cancelled, const SampleFunction &sample) const {
+		frame_buffer frame(image_width, row_count, Features);
+		// progress shared between threads
+		std::mutex log_mutex;
+		int rows_remaining = _image_height - first_row;
+		// render one row
+		auto render_row = [&](size_t row) {
+			if (cancelled != nullptr && *cancelled) {
+				return;
+			}
+			auto j = first_row + static_cast<int>(row);
+			// loop through pixels
+			for (int i = 0; i < image_width; ++i) {
+				auto index = row * image_width + i;
+				// calculate pixel colour by accumulating samples
+				colour pixel_colour(0, 0, 0);
+				colour albedo_sum(0, 0, 0);
+				vec3 normal_sum(0, 0, 0);
+				double depth_sum = 0, luminance_sum = 0, luminance_squared_sum = 0;
+				// loop through samples
+				for (int s = 0; s < samples_per_pixel; ++s) {
+					// trace a camera ray for the pixel
+					first_hit hit;
+					auto sample_colour = sample(i, j, Features ? &hit : nullptr);
+					pixel_colour += sample_colour;
+					if constexpr (Features) {
+						albedo_sum += hit.albedo;
+						normal_sum += hit.normal;
+						depth_sum += hit.depth;
+						auto luminance = 0.2126 * sample_colour[0] + 0.7152 * sample_colour[1] + 0.0722 * sample_colour[2];
+						luminance_sum += luminance;
+						luminance_squared_sum += luminance * luminance;
+					}
+				}
+				// store sample means
+				auto scale = 1.0 / samples_per_pixel;
+				frame.pixels[index] = pixel_colour * scale;
+				if constexpr (Features) {
+					frame.albedo[index] = albedo_sum * scale;
+					frame.normal[index] = normal_sum.nearZero() ? normal_sum : unitVector(normal_sum);
+					frame.depth[index] = depth_sum * scale;
+					// variance of the mean luminance
+					auto mean = luminance_sum * scale;
+					auto sample_variance = samples_per_pixel > 1
+						? fmax(0.0, luminance_squared_sum - samples_per_pixel * mean * mean) / (samples_per_pixel - 1)
+						: 0.0;
+					frame.variance[index] = sample_variance * scale;
+				}
+			}
+			// log progress
+			if (log_progress) {
+				std::lock_guard<std::mutex> lock(log_mutex);
+				std::clog << "\rScanlines remaining: " << --rows_remaining << " " << std::flush;
+			}
+		};
+		// loop through rows in parallel, keeping neighbouring rows on one node if pinning
+		if (numa != nullptr) {
+			numaParallelFor(row_count, thread_count, *numa, render_row, numa_stats);
+		} else {
+			parallelFor(row_count, thread_count, render_row);
+		}
+		return frame;
+	}
+
+	// render a set of pixels into a cache at the full sample count, recording the materials their paths touch
+	// parameters:
+	//   world: the specified hittable world
+	//   cache: the cache
+	//   pixels: the pixel indices to render
+	void renderPixels(const hittable& world, render_cache &cache, const std::vector<size_t> &pixels) const {
+		std::vector<std::vector<const material *>> touched(pixels.size());
+		auto render_pixel = [&](size_t k) {
+			auto p = pixels[k];
+			auto i = static_cast<int>(p % image_width), j = static_cast<int>(p / image_width);
+			colour pixel_colour(0, 0, 0);
+			for (int s = 0; s < samples_per_pixel; ++s) {
+				pixel_colour += rayColour(getRay(i, j), ray_depth, world, nullptr, &touched[k]);
+			}
+			cache.pixels[p] = pixel_colour / samples_per_pixel;
+			cache.samples[p] = static_cast<uint32_t>(samples_per_pixel);
+			// keep each material once
+			auto &list = touched[k];
+			std::sort(list.begin(), list.end());
+			list.erase(std::unique(list.begin(), list.end()), list.end());
+		};
+		// loop through pixels in parallel, keeping neighbouring pixels on one node if pinning
+		if (numa != nullptr) {
+			numaParallelFor(pixels.size(), thread_count, *numa, render_pixel, numa_stats);
+		} else {
+			parallelFor(pixels.size(), thread_count, render_pixel);
+		}
+		cache.setTouches(pixels, touched);
+	}
+
+	// trace a ray through the scene, sampling diffuse bounces from a mix of the lambertian lobe and a learned guide
+	// parameters:
+	//   r: the camera ray
+	//   world: the specified hittable world
+	//   features: if not null, filled with the surface properties at the first hit
+	//   guide: the learned distribution of light
+	//   training: record the light the path brings back to each diffuse bounce into the guide
+	// returns:
+	//   ray colour
+	colour traceGuided(ray r, const hittable& world, first_hit *features, sd_tree &guide, bool training) const {
+		// diffuse bounces of the path, with the path throughput after each
+		struct bounce {
+			point3 point;
+			vec3 direction;
+			double pdf;
+			colour throughput;
+		};
+		thread_local std::vector<bounce> bounces;
+		bounces.clear();
+		colour throughput(1, 1, 1);
+		for (int depth = ray_depth; depth > 0; --depth) {
+			hit_record record;
+			if (!world.hit(r, interval(0.001, infinity), record)) {
+				auto background = backgroundColour(r);
+				if (features != nullptr && depth == ray_depth) {
+					features->albedo = background;
+				}
+				auto radiance = throughput * background;
+				// the light reaching each bounce is what the path gathered after it
+				for (const auto &b : bounces) {
+					colour incoming;
+					for (int c = 0; c < 3; ++c) {
+						incoming[c] = b.throughput[c] > 0 ? radiance[c] / b.throughput[c] : 0;
+					}
+					guide.record(b.point, b.direction, (0.2126 * incoming[0] + 0.7152 * incoming[1] + 0.0722 * incoming[2]) / b.pdf);
+				}
+				return radiance;
+			}
+			if (features != nullptr && depth == ray_depth) {
+				features->albedo = record.material->albedo(record);
+				features->normal = record.normal;
+				features->depth = record.distance;
+			}
+			ray scattered;
+			colour attenuation;
+			if (dynamic_cast<const lambertian *>(record.material.get()) != nullptr) {
+				// pick the guide or the cosine-weighted lambertian lobe, then weight by the density of both
+				const auto &distribution = guide.find(record.point);
+				auto guided = distribution.trained() ? guiding_fraction : 0.0;
+				vec3 direction;
+				if (randomDouble() < guided) {
+					direction = distribution.sample();
+				} else {
+					auto lobe = record.normal + randomUnitVector();
+					direction = lobe.nearZero() ? record.normal : unitVector(lobe);
+				}
+				auto cosine = dot(record.normal, direction);
+				if (cosine <= 0) {
+					return colour(0, 0, 0);
+				}
+				auto pdf = guided * distribution.pdf(direction) + (1 - guided) * cosine / std::numbers::pi;
+				attenuation = record.material->albedo(record) * (cosine / std::numbers::pi / pdf);
+				scattered = ray(record.point, direction, r.time());
+				if (training) {
+					bounces.push_back({ record.point, direction, pdf, throughput * attenuation });
+				}
+			} else if (!record.material->scatter(r, record, attenuation, scattered)) {
+				return colour(0, 0, 0);
+			}
+			throughput = throughput * attenuation;
+			r = scattered;
+		}
+		// exceeded the ray bounce limit (no more light gathered)
+		return colour(0, 0, 0);
+	}
 
 	// initialise camera parameters
 	void initialise() {
@@ -97,6 +531,10 @@ private:
 		auto defocus_radius = focus_distance * tan(degreesToRadians(defocus_angle / 2));
 		_defocus_disk_u = _u * defocus_radius;
 		_defocus_disk_v = _v * defocus_radius;
+
+		// keep ray times within [0, 1], as moving objects only bound their path between time 0 and time 1
+		_shutter_open = std::clamp(shutter_open, 0.0, 1.0);
+		_shutter_close = std::clamp(shutter_close, _shutter_open, 1.0);
 	}
 
 	// calculate colour of a ray by tracing interactions within the scene
@@ -104,9 +542,12 @@ private:
 	//   r: the ray
 	//   depth: ray bounce limit
 	//   world: the specified hittable world
+	//   features: if not null, filled with the surface properties at the first hit
+	//   touched: if not null, receives the material of every surface hit along the path
 	// returns:
 	//   ray colour
-	colour rayColour(const ray& r, int depth, const hittable& world) const {
+	colour rayColour(const ray& r, int depth, const hittable& world, first_hit *features = nullptr,
+					 std::vector<const material *> *touched = nullptr) const {
 		// placeholder for record
 		hit_record record;
 		// check if exceeded the ray bounce limit (no more light gathered)
@@ -115,17 +556,41 @@ private:
 		}
 		// check for ray / object intersection
 		if (world.hit(r, interval(0.001, infinity), record)) {
+			// record first hit features
+			if (features != nullptr) {
+				features->albedo = record.material->albedo(record);
+				features->normal = record.normal;
+				features->depth = record.distance;
+			}
+			// record the material, which paths often hit in the sample before too
+			if (touched != nullptr && (touched->empty() || touched->back() != record.material.get())) {
+				touched->push_back(record.material.get());
+			}
 			ray scattered;
 			colour attenuation;
 			 // if material of the hit object scatters the ray, calculate the scattered ray and attenuation
 			if (record.material->scatter(r, record, attenuation, scattered)) {
 				// recursively trace scattered rays and calculate colour
-				return attenuation * rayColour(scattered, depth - 1, world);
+				return attenuation * rayColour(scattered, depth - 1, world, nullptr, touched);
 			}
 			// return colour
 			return colour(0, 0, 0);
 		}
-		// no intersection found, create a simple gradient background
+		// no intersection found
+		auto background = backgroundColour(r);
+		// record the background as the albedo of an escaped camera ray
+		if (features != nullptr) {
+			features->albedo = background;
+		}
+		return background;
+	}
+
+	// calculate the colour of a ray that escaped the scene, a simple gradient background
+	// parameters:
+	//   r: the ray
+	// returns:
+	//   background colour
+	static colour backgroundColour(const ray& r) {
 		auto unit_direction = unitVector(r.direction());
 		auto a = 0.5 * (unit_direction.y() + 1.0);
 		// linear interpolation between white and blue based on the ray's vertical direction.
@@ -146,8 +611,10 @@ private:
 		// calculate the ray origin and direction
 		auto ray_origin = (defocus_angle <= 0) ? _centre : defocusDiskSample();
 		auto ray_direction = pixel_sample - ray_origin;
+		// pick a random time within the shutter interval
+		auto ray_time = (_shutter_close > _shutter_open) ? randomDouble(_shutter_open, _shutter_close) : _shutter_open;
 		// return camera ray
-		return ray(ray_origin, ray_direction);
+		return ray(ray_origin, ray_direction, ray_time);
 	}
 
 	// generate a random vector in the square surrounding a pixel at the origin
@@ -15,31 +15,36 @@ inline double linearToGamma(double linear_component) {
 	return sqrt(linear_component);
 }
 
-// write a colour value to an output stream with gamma correction and scaling
+// convert a colour to 8-bit components with scaling, gamma correction and clamping
 // parameters:
-//   out: the output stream to write to
-//   pixel_colour: the colour value to be written
+//   pixel_colour: the colour value to be converted
 //   samples_per_pixel: the number of samples per pixel for scaling
-void writeColour(std::ostream &out, colour pixel_colour, int samples_per_pixel) {
-	// extract colour components
-	auto r = pixel_colour.x();
-	auto g = pixel_colour.y();
-	auto b = pixel_colour.z();
-
+//   rgb: receives the three (0,255) components
+inline void quantiseColour(colour pixel_colour, int samples_per_pixel, unsigned char rgb[3]) {
 	// divide colour by number of samples
 	auto scale = 1.0 / samples_per_pixel;
-	r *= scale;
-	g *= scale;
-	b *= scale;
+	// range of displayable intensities
+	static const interval intensity(0.0, 1.0);
+	for (int c = 0; c < 3; ++c) {
+		// apply linear to gamma correction and translate to a (0,255) value
+		auto component = linearToGamma(pixel_colour[c] * scale);
+		rgb[c] = static_cast<unsigned char>(round(intensity.clamp(component) * 255.0));
+	}
+}
 
-	// apply linear to gamma correction
-	r = linearToGamma(r);
-	g = linearToGamma(g);
-	b = linearToGamma(b);
+// write a colour value to an output stream with gamma correction and scaling
+// parameters:
+//   out: the output stream to write to
+//   pixel_colour: the colour value to be written
+//   samples_per_pixel: the number of samples per pixel for scaling
+inline void writeColour(std::ostream &out, colour pixel_colour, int samples_per_pixel) {
+	// convert colour components
+	unsigned char rgb[3];
+	quantiseColour(pixel_colour, samples_per_pixel, rgb);
 
 	// write translated (0,255) value of each colour component
-	out << static_cast<int>(round(r * 255.0)) << " "
-		<< static_cast<int>(round(g * 255.0)) << " "
-		<< static_cast<int>(round(b * 255.0)) << "\n";
+	out << static_cast<int>(rgb[0]) << " "
+		<< static_cast<int>(rgb[1]) << " "
+		<< static_cast<int>(rgb[2]) << "\n";
 
 }
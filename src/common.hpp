@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include <numbers>
 #include <random>
@@ -15,17 +16,29 @@ inline double degreesToRadians(double degrees) {
 	return degrees * (std::numbers::pi / 180.0);
 }
 
+// return the per-thread random number generator (reseed it to repeat a sequence, eg. to rebuild a scene)
+inline std::mt19937 &randomGenerator() {
+	// define a per-thread random number generator initialised with a seed from std::random_device
+	thread_local std::mt19937 generator(std::random_device{}());
+	return generator;
+}
+
 // generate a random double-precision number in the range [0, 1)
 inline double randomDouble() {
-	// define a static distribution that generates random doubles in the range [0.0, 1.0)
-	static std::uniform_real_distribution<double> distribution(0.0, 1.0);
-	// define a static random number generator initialised with a seed from std::random_device
-	static std::mt19937 generator(std::random_device{}());
+	// define a per-thread distribution that generates random doubles in the range [0.0, 1.0)
+	thread_local std::uniform_real_distribution<double> distribution(0.0, 1.0);
 	// return random double using distribution and generator
-	return distribution(generator);
+	return distribution(randomGenerator());
 }
 
 // generate a random double-precision number in the range [min, max)
 inline double randomDouble(double min, double max) {
 	return min + (max - min) * randomDouble();
 }
+
+// scramble a 64-bit value (splitmix64 finaliser), so nearby inputs give unrelated outputs
+inline uint64_t mixBits(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
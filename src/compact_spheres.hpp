@@ -0,0 +1,195 @@
+#pragma once
+#include "flat_bvh.hpp"
+#include "material_table.hpp"
+#include "sphere.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+// a class representing many spheres in compact storage, with their own flattened bvh
+// (spheres are grouped into leaf clusters; each sphere is stored as a float offset from its cluster origin (the
+// float minimum corner of the leaf box) and a float radius, with a float displacement only if some sphere moves, and
+// an Index (uint16_t or uint32_t) into a shared material_table in place of a shared_ptr; there is no object or vtable
+// per sphere; clusters are split until their box spans at most max_span_radii radii of their smallest sphere, so a
+// large sphere such as the ground never shares a cluster with small ones and every offset is precise to about
+// 2^-18 of the smallest radius in its cluster)
+template <typename Index>
+class compact_spheres : public hittable {
+public:
+
+	// constructor to convert spheres into compact storage
+	// parameters:
+	//   objects: the spheres (anything else is rejected)
+	//   materials: the table interning the spheres' materials
+	compact_spheres(const std::vector<shared_ptr<hittable>> &objects, shared_ptr<material_table> materials)
+		: _table(materials) {
+		std::vector<flat_bvh::item> items;
+		items.reserve(objects.size());
+		std::vector<point3> centres;
+		std::vector<vec3> displacements;
+		std::vector<double> radii;
+		std::vector<uint32_t> material_indices;
+		for (const auto &object : objects) {
+			auto s = std::dynamic_pointer_cast<sphere>(object);
+			if (s == nullptr) {
+				throw std::invalid_argument("compact_spheres holds spheres only");
+			}
+			auto index = _table->intern(s->surface());
+			if (index > std::numeric_limits<Index>::max()) {
+				throw std::overflow_error("too many distinct materials for the material index type");
+			}
+			// round the box outwards to floats so it never clips the sphere
+			flat_bvh::item item;
+			auto box = s->boundingBox();
+			for (int a = 0; a < 3; ++a) {
+				auto lower = static_cast<float>(box.axis(a).min);
+				auto upper = static_cast<float>(box.axis(a).max);
+				item.min[a] = lower > box.axis(a).min ? std::nextafter(lower, -INFINITY) : lower;
+				item.max[a] = upper < box.axis(a).max ? std::nextafter(upper, INFINITY) : upper;
+				item.centre[a] = static_cast<float>(0.5 * (box.axis(a).min + box.axis(a).max));
+			}
+			item.index = static_cast<uint32_t>(items.size());
+			items.push_back(item);
+			centres.push_back(s->startCentre());
+			displacements.push_back(s->displacement());
+			radii.push_back(s->radius());
+			material_indices.push_back(index);
+		}
+		// build, splitting clusters whose box is large against their smallest sphere
+		_bvh.build(items, [&](uint32_t start, uint32_t end) {
+			float box_min[3] = { INFINITY, INFINITY, INFINITY }, box_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+			auto smallest = infinity;
+			for (auto i = start; i < end; ++i) {
+				for (int a = 0; a < 3; ++a) {
+					box_min[a] = std::min(box_min[a], items[i].min[a]);
+					box_max[a] = std::max(box_max[a], items[i].max[a]);
+				}
+				smallest = std::min(smallest, radii[items[i].index]);
+			}
+			for (int a = 0; a < 3; ++a) {
+				if (box_max[a] - box_min[a] > max_span_radii * smallest) {
+					return false;
+				}
+			}
+			return true;
+		});
+		_bbox = _bvh.bounds();
+
+		// store the spheres in leaf order, relative to their cluster origins
+		auto moving = std::any_of(displacements.begin(), displacements.end(), [](const vec3 &d) { return !d.nearZero(); });
+		_spheres.resize(items.size());
+		_materials.resize(items.size());
+		if (moving) {
+			_displacements.resize(items.size());
+		}
+		for (const auto &n : _bvh.nodes()) {
+			if (n.count == 0) {
+				continue;
+			}
+			for (auto i = n.offset; i < n.offset + n.count; ++i) {
+				auto original = items[i].index;
+				for (int a = 0; a < 3; ++a) {
+					_spheres[i].offset[a] = static_cast<float>(centres[original][a] - n.min[a]);
+					if (moving) {
+						_displacements[i][a] = static_cast<float>(displacements[original][a]);
+					}
+				}
+				_spheres[i].radius = static_cast<float>(radii[original]);
+				_materials[i] = static_cast<Index>(material_indices[original]);
+			}
+		}
+	}
+
+	// check for ray / sphere intersection by walking the hierarchy
+	// parameters:
+	//   r: the ray
+	//	 ray_t: an interval representing the range of intersection values
+	//   rec: the record containing intersection information
+	// returns:
+	//   true if an intersection matched else false
+	bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+		auto direction = r.direction();
+		auto a = direction.lengthSquared();
+		// placeholders for hit detection
+		uint32_t hit_sphere = 0;
+		point3 hit_centre;
+		// test each sphere of the leaves the ray reaches, relative to the cluster origin
+		auto hit_anything = _bvh.traverse(r, ray_t, [&](const flat_bvh::node &leaf, interval &leaf_t) {
+			auto hit_leaf = false;
+			point3 origin(leaf.min[0], leaf.min[1], leaf.min[2]);
+			for (auto i = leaf.offset; i < leaf.offset + leaf.count; ++i) {
+				const auto &s = _spheres[i];
+				auto centre = origin + vec3(s.offset[0], s.offset[1], s.offset[2]);
+				if (!_displacements.empty()) {
+					centre += r.time() * vec3(_displacements[i][0], _displacements[i][1], _displacements[i][2]);
+				}
+				// solve for the nearest root within the interval
+				auto oc = r.origin() - centre;
+				auto half_b = dot(oc, direction);
+				auto c = oc.lengthSquared() - double(s.radius) * s.radius;
+				auto discriminant = half_b * half_b - a * c;
+				if (discriminant < 0) {
+					continue;
+				}
+				auto sqrtd = sqrt(discriminant);
+				auto root = (-half_b - sqrtd) / a;
+				if (!leaf_t.surrounds(root)) {
+					root = (-half_b + sqrtd) / a;
+					if (!leaf_t.surrounds(root)) {
+						continue;
+					}
+				}
+				hit_leaf = true;
+				leaf_t.max = root;
+				hit_sphere = i;
+				hit_centre = centre;
+			}
+			return hit_leaf;
+		});
+		if (!hit_anything) {
+			return false;
+		}
+		// update hit_record
+		rec.distance = ray_t.max;
+		rec.point = r.at(rec.distance);
+		auto outward_normal = (rec.point - hit_centre) / _spheres[hit_sphere].radius;
+		rec.setFaceNormal(r, outward_normal);
+		sphere::getSphereUV(outward_normal, rec.u, rec.v);
+		rec.material = (*_table)[_materials[hit_sphere]];
+		// intersection found
+		return true;
+	}
+
+	// return the box enclosing every sphere
+	aabb boundingBox() const override { return _bbox; }
+
+	// return the number of spheres
+	size_t sphereCount() const { return _spheres.size(); }
+
+	// return the bytes held by the spheres and hierarchy (the shared material table is counted separately)
+	size_t bytes() const {
+		return _spheres.capacity() * sizeof(sphere_record) + _displacements.capacity() * sizeof(_displacements[0]) +
+			   _materials.capacity() * sizeof(Index) + _bvh.bytes();
+	}
+
+private:
+
+	// a sphere relative to its cluster origin
+	struct sphere_record {
+		float offset[3];			// centre at time 0, relative to the cluster origin
+		float radius;				// radius
+	};
+
+	static constexpr double max_span_radii = 64;		// widest cluster box, in radii of its smallest sphere
+
+	std::vector<sphere_record> _spheres;	// spheres, ordered by leaf
+	std::vector<std::array<float, 3>> _displacements;	// displacement from time 0 to 1 (empty if nothing moves)
+	std::vector<Index> _materials;			// material table index of each sphere
+	flat_bvh _bvh;							// hierarchy over the spheres, one cluster per leaf
+	shared_ptr<material_table> _table;		// distinct materials
+	aabb _bbox;								// box enclosing every sphere
+
+};
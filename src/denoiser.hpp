@@ -0,0 +1,136 @@
+#pragma once
+#include "frame_buffer.hpp"
+#include "parallel.hpp"
+
+// a class representing an edge-aware à-trous wavelet denoiser guided by the frame's feature buffers
+// (the colour is divided by the albedo so texture detail is kept, then filtered with a 5x5 b3-spline kernel whose
+// taps are spread 1, 2, 4, ... pixels apart on successive passes, each tap weighted down across differences in
+// luminance, normal, depth and albedo; luminance differences are judged against the noise level, estimated from the
+// variance blurred over the neighbouring pixels)
+class denoiser {
+public:
+
+	int iterations = 1;						// number of filter passes (the footprint doubles with each)
+	double sigma_luminance = 2.5;			// luminance tolerance, in standard deviations of the pixel noise
+	double sigma_normal = 128.0;			// normal similarity exponent (higher keeps creases sharper)
+	double sigma_depth = 0.1;				// relative depth tolerance
+	double sigma_albedo = 0.1;				// albedo tolerance
+
+	// filter the colour of a frame in place
+	// parameters:
+	//   frame: the frame, which must have feature buffers
+	//   threads: the number of threads (0 uses every hardware thread)
+	void filter(frame_buffer &frame, unsigned threads = 0) const {
+		auto count = frame.pixels.size();
+		// demodulate albedo, scaling the variance by the same factor
+		std::vector<colour> illumination(count), filtered(count);
+		std::vector<double> variance(count), filtered_variance(count);
+		for (size_t i = 0; i < count; ++i) {
+			auto a = safeAlbedo(frame.albedo[i]);
+			illumination[i] = vec3(frame.pixels[i][0] / a[0], frame.pixels[i][1] / a[1], frame.pixels[i][2] / a[2]);
+			auto scale = luminance(a);
+			variance[i] = frame.variance[i] / (scale * scale);
+		}
+
+		// run the filter passes, ping-ponging between buffers
+		for (int pass = 0; pass < iterations; ++pass) {
+			auto step = 1 << pass;
+			parallelFor(frame.height, threads, [&](size_t y) {
+				for (int x = 0; x < frame.width; ++x) {
+					filterPixel(frame, illumination, variance, filtered, filtered_variance, x, static_cast<int>(y), step);
+				}
+			});
+			illumination.swap(filtered);
+			variance.swap(filtered_variance);
+		}
+
+		// remodulate albedo
+		for (size_t i = 0; i < count; ++i) {
+			frame.pixels[i] = illumination[i] * safeAlbedo(frame.albedo[i]);
+		}
+	}
+
+private:
+
+	// return the luminance of a colour
+	static double luminance(const colour &c) {
+		return 0.2126 * c[0] + 0.7152 * c[1] + 0.0722 * c[2];
+	}
+
+	// return an albedo with no component close enough to zero to blow up on division
+	static colour safeAlbedo(const colour &a) {
+		return colour(fmax(a[0], 0.01), fmax(a[1], 0.01), fmax(a[2], 0.01));
+	}
+
+	// return the variance around a pixel, blurred with a 3x3 gaussian so single noisy estimates do not set the
+	// luminance tolerance
+	static double blurredVariance(const frame_buffer &frame, const std::vector<double> &variance, int x, int y) {
+		static constexpr double kernel[3] = { 1.0 / 4, 1.0 / 2, 1.0 / 4 };
+		auto sum = 0.0;
+		auto weight_sum = 0.0;
+		for (int dy = -1; dy <= 1; ++dy) {
+			auto qy = y + dy;
+			if (qy < 0 || qy >= frame.height) {
+				continue;
+			}
+			for (int dx = -1; dx <= 1; ++dx) {
+				auto qx = x + dx;
+				if (qx < 0 || qx >= frame.width) {
+					continue;
+				}
+				auto weight = kernel[dx + 1] * kernel[dy + 1];
+				sum += weight * fmax(variance[static_cast<size_t>(qy) * frame.width + qx], 0.0);
+				weight_sum += weight;
+			}
+		}
+		return sum / weight_sum;
+	}
+
+	// filter one pixel for one pass
+	void filterPixel(const frame_buffer &frame, const std::vector<colour> &input, const std::vector<double> &input_variance,
+					 std::vector<colour> &output, std::vector<double> &output_variance, int x, int y, int step) const {
+		// b3-spline kernel weights
+		static constexpr double kernel[5] = { 1.0 / 16, 1.0 / 4, 3.0 / 8, 1.0 / 4, 1.0 / 16 };
+		auto p = static_cast<size_t>(y) * frame.width + x;
+		auto luminance_p = luminance(input[p]);
+		auto luminance_scale = 1.0 / (sigma_luminance * sqrt(blurredVariance(frame, input_variance, x, y)) + 1e-6);
+		colour sum(0, 0, 0);
+		auto weight_sum = 0.0;
+		auto variance_sum = 0.0;
+		for (int dy = -2; dy <= 2; ++dy) {
+			auto qy = y + dy * step;
+			if (qy < 0 || qy >= frame.height) {
+				continue;
+			}
+			for (int dx = -2; dx <= 2; ++dx) {
+				auto qx = x + dx * step;
+				if (qx < 0 || qx >= frame.width) {
+					continue;
+				}
+				auto q = static_cast<size_t>(qy) * frame.width + qx;
+				// edge-stopping weights
+				auto w_luminance = fabs(luminance(input[q]) - luminance_p) * luminance_scale;
+				auto w_normal = pow(fmax(0.0, dot(frame.normal[p], frame.normal[q])), sigma_normal);
+				auto depth_difference = fabs(frame.depth[p] - frame.depth[q]) / (sigma_depth * fmax(frame.depth[p], frame.depth[q]) + 1e-6);
+				auto w_albedo = (frame.albedo[p] - frame.albedo[q]).lengthSquared() / (sigma_albedo * sigma_albedo);
+				// pixels where the ray escaped have a zero normal, so compare them by depth alone
+				if (frame.depth[p] == 0 && frame.depth[q] == 0) {
+					w_normal = 1;
+				}
+				auto weight = kernel[dx + 2] * kernel[dy + 2] * w_normal * exp(-w_luminance - depth_difference - w_albedo);
+				sum += weight * input[q];
+				weight_sum += weight;
+				variance_sum += weight * weight * input_variance[q];
+			}
+		}
+		// keep the pixel unchanged if every weight underflowed
+		if (weight_sum <= 0) {
+			output[p] = input[p];
+			output_variance[p] = input_variance[p];
+			return;
+		}
+		output[p] = sum / weight_sum;
+		output_variance[p] = variance_sum / (weight_sum * weight_sum);
+	}
+
+};
@@ -34,13 +34,16 @@ public:
 			direction = refract(unit_direction, rec.normal, refraction_ratio);
 		}
   		// create the scattered ray
-		scattered = ray(rec.point, direction);
+		scattered = ray(rec.point, direction, r_in.time());
 		// set attenuation to white
 		attenuation = colour(1.0, 1.0, 1.0);
 		// always scatters
 		return true;
 	}
 
+	// return the index of refraction
+	double refractionIndex() const { return _ior; }
+
 private:
 
 	double _ior;			// the index of refraction
@@ -0,0 +1,218 @@
+#pragma once
+#include "hittable.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// a class representing a bounding volume hierarchy over float boxes, flattened into one array with the left child of
+// each node directly following its parent
+// (used by hittables that keep their primitives in flat arrays: building reorders the items so each leaf covers a
+// contiguous range, which the owner then applies to its own arrays, and traversal hands each leaf the ray reaches
+// back to the owner to test its primitives)
+class flat_bvh {
+public:
+
+	// a primitive being sorted into the hierarchy
+	struct item {
+		float min[3];				// box minimum corner
+		float max[3];				// box maximum corner
+		float centre[3];			// box centre
+		uint32_t index;				// original primitive index
+	};
+
+	// a node of the flattened hierarchy
+	struct node {
+		float min[3];				// box minimum corner
+		float max[3];				// box maximum corner
+		uint32_t offset;			// first item (leaf) or right child index (interior)
+		uint16_t count;				// number of items (0 for interior nodes)
+		uint16_t axis;				// split axis (interior nodes)
+
+		// check for ray / box intersection using the slab method
+		bool hit(const point3 &origin, const vec3 &inverse_direction, interval ray_t) const {
+			for (int a = 0; a < 3; ++a) {
+				auto t0 = (min[a] - origin[a]) * inverse_direction[a];
+				auto t1 = (max[a] - origin[a]) * inverse_direction[a];
+				if (inverse_direction[a] < 0) {
+					std::swap(t0, t1);
+				}
+				if (t0 > ray_t.min) ray_t.min = t0;
+				if (t1 < ray_t.max) ray_t.max = t1;
+				if (ray_t.max < ray_t.min) {
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	static constexpr uint32_t max_leaf_size = 4;		// maximum items per leaf
+
+	// build the hierarchy, reordering the items so each leaf covers a contiguous range
+	// parameters:
+	//   items: the primitives (reordered in place)
+	//   leaf_allowed: called with a range of at most max_leaf_size items, returns false to split the range further
+	template <typename LeafTest>
+	void build(std::vector<item> &items, const LeafTest &leaf_allowed) {
+		_nodes.clear();
+		if (items.empty()) {
+			return;
+		}
+		// split the upper levels across threads
+		auto threads = std::max(1u, std::thread::hardware_concurrency());
+		auto parallel_depth = 0;
+		while ((1u << parallel_depth) < threads) {
+			++parallel_depth;
+		}
+		_nodes.reserve(2 * items.size() / max_leaf_size + 1);
+		buildNode(_nodes, items, 0, static_cast<uint32_t>(items.size()), parallel_depth, leaf_allowed);
+	}
+
+	// build the hierarchy, making a leaf of every range of at most max_leaf_size items
+	void build(std::vector<item> &items) {
+		build(items, [](uint32_t, uint32_t) { return true; });
+	}
+
+	// walk the hierarchy nearest child first, handing each leaf the ray reaches to a function
+	// parameters:
+	//   r: the ray
+	//   ray_t: the range of intersection values, whose max the leaf function lowers to the distance of each hit
+	//   leaf: called with the leaf node and ray_t, returns true if it hit a primitive
+	// returns:
+	//   true if any leaf hit a primitive
+	template <typename LeafFunction>
+	bool traverse(const ray &r, interval &ray_t, const LeafFunction &leaf) const {
+		if (_nodes.empty()) {
+			return false;
+		}
+		auto origin = r.origin();
+		auto direction = r.direction();
+		vec3 inverse_direction(1 / direction[0], 1 / direction[1], 1 / direction[2]);
+		auto hit_anything = false;
+		// walk the hierarchy with an explicit stack
+		uint32_t stack[64];
+		int stack_size = 0;
+		stack[stack_size++] = 0;
+		while (stack_size > 0) {
+			const auto &n = _nodes[stack[--stack_size]];
+			if (!n.hit(origin, inverse_direction, ray_t)) {
+				continue;
+			}
+			if (n.count > 0) {
+				hit_anything |= leaf(n, ray_t);
+			} else {
+				// interior, push the far child first so the near child is visited first
+				auto left = static_cast<uint32_t>(&n - _nodes.data()) + 1;
+				auto right = n.offset;
+				if (direction[n.axis] < 0) {
+					std::swap(left, right);
+				}
+				stack[stack_size++] = right;
+				stack[stack_size++] = left;
+			}
+		}
+		return hit_anything;
+	}
+
+	// return the box enclosing every item (empty if there are none)
+	aabb bounds() const {
+		if (_nodes.empty()) {
+			return aabb();
+		}
+		return aabb(interval(_nodes[0].min[0], _nodes[0].max[0]), interval(_nodes[0].min[1], _nodes[0].max[1]),
+					interval(_nodes[0].min[2], _nodes[0].max[2]));
+	}
+
+	// return the nodes, root first
+	const std::vector<node> &nodes() const { return _nodes; }
+
+	// return the bytes held by the nodes
+	size_t bytes() const { return _nodes.capacity() * sizeof(node); }
+
+private:
+
+	std::vector<node> _nodes;				// flattened hierarchy, root first
+
+	// recursively build a subtree over a range of items, appending its nodes to a vector
+	// parameters:
+	//   nodes: the vector receiving the nodes (child offsets are relative to its start)
+	//   items: the items being sorted (reordered in place)
+	//   start, end: the range of items
+	//   parallel_depth: number of further levels whose left subtree is built on another thread
+	//   leaf_allowed: as for build
+	// returns:
+	//   the index of the node
+	template <typename LeafTest>
+	static uint32_t buildNode(std::vector<node> &nodes, std::vector<item> &items, uint32_t start, uint32_t end,
+							  int parallel_depth, const LeafTest &leaf_allowed) {
+		// bound the items and their centres
+		float box_min[3] = { INFINITY, INFINITY, INFINITY }, box_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+		float centre_min[3] = { INFINITY, INFINITY, INFINITY }, centre_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+		for (auto i = start; i < end; ++i) {
+			for (int a = 0; a < 3; ++a) {
+				box_min[a] = std::min(box_min[a], items[i].min[a]);
+				box_max[a] = std::max(box_max[a], items[i].max[a]);
+				centre_min[a] = std::min(centre_min[a], items[i].centre[a]);
+				centre_max[a] = std::max(centre_max[a], items[i].centre[a]);
+			}
+		}
+		auto index = static_cast<uint32_t>(nodes.size());
+		nodes.push_back(node{});
+		// store the box, padded by one float step so rounding never clips an item
+		for (int a = 0; a < 3; ++a) {
+			nodes[index].min[a] = std::nextafter(box_min[a], -INFINITY);
+			nodes[index].max[a] = std::nextafter(box_max[a], INFINITY);
+		}
+		auto axis = 0;
+		for (int a = 1; a < 3; ++a) {
+			if (centre_max[a] - centre_min[a] > centre_max[axis] - centre_min[axis]) {
+				axis = a;
+			}
+		}
+		auto count = end - start;
+		auto small = count <= max_leaf_size && (count == 1 || leaf_allowed(start, end));
+		if (small || (count > max_leaf_size && centre_max[axis] <= centre_min[axis] && count <= UINT16_MAX)) {
+			// leaf (also used when every centre of a larger range coincides and the range cannot be split usefully)
+			nodes[index].offset = start;
+			nodes[index].count = static_cast<uint16_t>(count);
+			return index;
+		}
+		// split at the median centre along the longest axis
+		auto mid = start + (end - start) / 2;
+		std::nth_element(items.begin() + start, items.begin() + mid, items.begin() + end,
+			[axis](const item &a, const item &b) { return a.centre[axis] < b.centre[axis]; });
+		uint32_t right;
+		if (parallel_depth > 0 && end - start > 65536) {
+			// build both subtrees concurrently into separate vectors, then splice them after this node
+			std::vector<node> left_nodes, right_nodes;
+			std::thread left_builder([&] { buildNode(left_nodes, items, start, mid, parallel_depth - 1, leaf_allowed); });
+			buildNode(right_nodes, items, mid, end, parallel_depth - 1, leaf_allowed);
+			left_builder.join();
+			appendNodes(nodes, left_nodes);
+			right = appendNodes(nodes, right_nodes);
+		} else {
+			buildNode(nodes, items, start, mid, parallel_depth, leaf_allowed);
+			right = buildNode(nodes, items, mid, end, parallel_depth, leaf_allowed);
+		}
+		nodes[index].offset = right;
+		nodes[index].count = 0;
+		nodes[index].axis = static_cast<uint16_t>(axis);
+		return index;
+	}
+
+	// append a separately built subtree, rebasing its interior child offsets
+	// returns:
+	//   the index of the subtree root
+	static uint32_t appendNodes(std::vector<node> &nodes, const std::vector<node> &subtree) {
+		auto base = static_cast<uint32_t>(nodes.size());
+		for (auto n : subtree) {
+			if (n.count == 0) {
+				n.offset += base;
+			}
+			nodes.push_back(n);
+		}
+		return base;
+	}
+
+};
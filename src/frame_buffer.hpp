@@ -0,0 +1,63 @@
+#pragma once
+#include "colour.hpp"
+#include <fstream>
+#include <string>
+#include <vector>
+
+// a class representing a rendered image and its auxiliary feature buffers (aovs), in row-major order
+class frame_buffer {
+public:
+
+	int width = 0;							// image width in pixels
+	int height = 0;							// image height in pixels
+	std::vector<colour> pixels;				// mean pixel colour (linear)
+	std::vector<double> variance;			// variance of the mean pixel luminance (feature buffers only)
+	std::vector<colour> albedo;				// mean first-hit albedo (feature buffers only)
+	std::vector<vec3> normal;				// mean first-hit shading normal (feature buffers only)
+	std::vector<double> depth;				// mean first-hit distance, 0 where the ray escaped (feature buffers only)
+
+	// constructor to allocate the buffers
+	// parameters:
+	//   w: image width
+	//   h: image height
+	//   features: also allocate the auxiliary feature buffers
+	frame_buffer(int w, int h, bool features)
+		: width(w), height(h), pixels(static_cast<size_t>(w) * h) {
+		if (features) {
+			variance.resize(pixels.size());
+			albedo.resize(pixels.size());
+			normal.resize(pixels.size());
+			depth.resize(pixels.size());
+		}
+	}
+
+	// return true if the auxiliary feature buffers are present
+	bool hasFeatures() const { return !albedo.empty(); }
+
+	// write the feature buffers as images named <prefix>_albedo.ppm, <prefix>_normal.ppm and <prefix>_depth.ppm
+	// parameters:
+	//   prefix: path prefix of the images
+	void writeFeatures(const std::string &prefix) const {
+		std::ofstream albedo_out(prefix + "_albedo.ppm");
+		std::ofstream normal_out(prefix + "_normal.ppm");
+		std::ofstream depth_out(prefix + "_depth.ppm");
+		for (auto *out : { &albedo_out, &normal_out, &depth_out }) {
+			*out << "P3\n" << width << " " << height << "\n255\n";
+		}
+		// normalise depth by the furthest hit
+		auto max_depth = 0.0;
+		for (auto d : depth) {
+			max_depth = fmax(max_depth, d);
+		}
+		auto depth_scale = max_depth > 0 ? 1.0 / max_depth : 0.0;
+		for (size_t i = 0; i < pixels.size(); ++i) {
+			writeColour(albedo_out, albedo[i], 1);
+			// map normals from [-1, 1] to [0, 1], squared to cancel the gamma correction
+			auto n = 0.5 * (normal[i] + vec3(1, 1, 1));
+			writeColour(normal_out, n * n, 1);
+			auto d = depth[i] * depth_scale;
+			writeColour(depth_out, colour(d, d, d) * d, 1);
+		}
+	}
+
+};
@@ -16,6 +16,9 @@ public:
 	shared_ptr<material> material;
 	// hit distance along the ray
 	double distance;
+	// surface texture coordinates of the point that was hit
+	double u;
+	double v;
 	// was hit on front face of object
 	bool front_face;
 
@@ -1,4 +1,5 @@
 #pragma once
+#include "aabb.hpp"
 #include "hit_record.h"
 
 // an absract class representing objects that can be hit by rays
@@ -13,6 +14,10 @@ public:
 	//   true if an intersection matched else false
 	virtual bool hit(const ray &r, interval ray_t, hit_record &rec) const = 0;
 
+	// returns:
+	//   a box enclosing the object over the whole shutter interval (for moving objects, the swept volume)
+	virtual aabb boundingBox() const = 0;
+
 	// destructor to ensure cleanup in derived classes
 	virtual ~hittable() = default;
 
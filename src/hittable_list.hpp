@@ -21,11 +21,13 @@ public:
 	// add object to the list
 	void add(shared_ptr<hittable> object) {
 		objects.push_back(object);
+		_bbox = aabb(_bbox, object->boundingBox());
 	}
 
 	// clear list of objects
 	void clear() {
 		objects.clear();
+		_bbox = aabb();
 	}
 
 	// check for intersections within an interval and update hit_record with matches
@@ -55,4 +57,12 @@ public:
 		// intersection matched
 		return hit_anything;
 	}
+
+	// return the box enclosing every object in the list
+	aabb boundingBox() const override { return _bbox; }
+
+private:
+
+	aabb _bbox;							// box enclosing all objects
+
 };
@@ -0,0 +1,301 @@
+#pragma once
+#include "texture.hpp"
+#include "tile_cache.hpp"
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// a derived class representing an image texture read lazily from a tiled, mip-mapped file
+// (file layout, native byte order: an 8-byte magic, then tile size and level count as uint32, then per level
+// its width, height and tile counts as uint32 and the file offset of its first tile as uint64, followed by
+// every level's tiles in row-major order; each tile holds tile_size * tile_size gamma-encoded 8-bit rgb texels)
+class image_texture : public texture {
+public:
+
+	// constructor to open a tiled image, reading only its header
+	// parameters:
+	//   path: path of a file written by convertPpm
+	//   cache: the tile cache shared by every image texture
+	//   mip_level: the level sampled, 0 for full resolution (coarser levels touch fewer tiles, eg. for distant
+	//              objects or previews)
+	image_texture(const std::string &path, shared_ptr<tile_cache> cache, int mip_level = 0)
+		: _cache(cache), _id(nextId()) {
+		_fd = open(path.c_str(), O_RDONLY);
+		if (_fd < 0) {
+			throw std::runtime_error("unable to open " + path);
+		}
+		// read and check the header
+		char magic[8] = {};
+		uint32_t level_count = 0;
+		auto valid = pread(_fd, magic, sizeof(magic), 0) == sizeof(magic)
+			&& pread(_fd, &_tile_size, sizeof(_tile_size), 8) == sizeof(_tile_size)
+			&& pread(_fd, &level_count, sizeof(level_count), 12) == sizeof(level_count)
+			&& std::memcmp(magic, file_magic, sizeof(magic)) == 0 && _tile_size > 0 && level_count > 0;
+		// clamp to the coarsest level available and read its description
+		_level = std::clamp(mip_level, 0, std::max(1, static_cast<int>(level_count)) - 1);
+		valid = valid && pread(_fd, &_level_info, sizeof(_level_info), 16 + _level * sizeof(level_info)) == sizeof(_level_info);
+		// check every tile of the level is in the file, so a short file is reported here rather than while rendering
+		struct stat info;
+		auto tile_bytes = static_cast<uint64_t>(_tile_size) * _tile_size * 3;
+		valid = valid && fstat(_fd, &info) == 0 && _level_info.width > 0 && _level_info.height > 0 &&
+				static_cast<uint64_t>(info.st_size) >= _level_info.offset + tile_bytes * _level_info.tiles_x * _level_info.tiles_y;
+		if (!valid) {
+			close(_fd);
+			throw std::runtime_error("not a tiled image " + path);
+		}
+	}
+
+	// destructor to close the file
+	~image_texture() {
+		close(_fd);
+	}
+
+	// return the width of the sampled level in texels
+	uint32_t width() const { return _level_info.width; }
+
+	// return the height of the sampled level in texels
+	uint32_t height() const { return _level_info.height; }
+
+	image_texture(const image_texture &) = delete;
+	image_texture &operator=(const image_texture &) = delete;
+
+	// return the bilinearly filtered texture colour
+	// parameters:
+	//   u, v: the surface texture coordinates (v = 1 at the top row of the image)
+	//   (the position of the point is not used)
+	colour value(double u, double v, const point3 &) const override {
+		// map texture coordinates to continuous texel coordinates
+		auto x = interval(0, 1).clamp(u) * _level_info.width - 0.5;
+		auto y = (1.0 - interval(0, 1).clamp(v)) * _level_info.height - 0.5;
+		auto x0 = static_cast<int>(std::floor(x));
+		auto y0 = static_cast<int>(std::floor(y));
+		auto fx = x - x0;
+		auto fy = y - y0;
+		// fetch the four surrounding texels, reusing the tile between fetches
+		tile_cache::tile current;
+		uint32_t current_index = UINT32_MAX;
+		auto t00 = texel(x0, y0, current, current_index);
+		auto t10 = texel(x0 + 1, y0, current, current_index);
+		auto t01 = texel(x0, y0 + 1, current, current_index);
+		auto t11 = texel(x0 + 1, y0 + 1, current, current_index);
+		return (1 - fy) * ((1 - fx) * t00 + fx * t10) + fy * ((1 - fx) * t01 + fx * t11);
+	}
+
+	// convert a ppm image (p3 or p6, 8-bit) into a tiled, mip-mapped file
+	// (an offline step, the source image is held in memory while converting)
+	// parameters:
+	//   input: path of the ppm image
+	//   output: path of the tiled file to write
+	//   tile_size: width and height of each tile in texels
+	static void convertPpm(const std::string &input, const std::string &output, uint32_t tile_size = 64) {
+		// read the source image
+		std::ifstream in(input, std::ios::binary);
+		std::string format;
+		int width = 0, height = 0, max_value = 0;
+		in >> format >> width >> height >> max_value;
+		if (!in || (format != "P3" && format != "P6") || width <= 0 || height <= 0 || max_value != 255) {
+			throw std::runtime_error("unsupported ppm " + input);
+		}
+		std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * 3);
+		if (format == "P6") {
+			in.get();
+			in.read(reinterpret_cast<char *>(pixels.data()), pixels.size());
+		} else {
+			for (auto &component : pixels) {
+				int value;
+				in >> value;
+				component = static_cast<uint8_t>(value);
+			}
+		}
+		if (!in) {
+			throw std::runtime_error("truncated ppm " + input);
+		}
+
+		// build the pyramid, halving (rounding up) until a single texel remains
+		std::vector<std::vector<uint8_t>> levels{ std::move(pixels) };
+		std::vector<std::pair<uint32_t, uint32_t>> sizes{ { static_cast<uint32_t>(width), static_cast<uint32_t>(height) } };
+		while (sizes.back().first > 1 || sizes.back().second > 1) {
+			levels.push_back(downsample(levels.back(), sizes.back().first, sizes.back().second));
+			sizes.emplace_back(halve(sizes.back().first), halve(sizes.back().second));
+		}
+
+		// describe each level
+		auto level_count = static_cast<uint32_t>(levels.size());
+		auto tile_bytes = static_cast<uint64_t>(tile_size) * tile_size * 3;
+		std::vector<level_info> infos(level_count);
+		uint64_t offset = 16 + level_count * sizeof(level_info);
+		for (uint32_t l = 0; l < level_count; ++l) {
+			infos[l].width = sizes[l].first;
+			infos[l].height = sizes[l].second;
+			infos[l].tiles_x = (infos[l].width + tile_size - 1) / tile_size;
+			infos[l].tiles_y = (infos[l].height + tile_size - 1) / tile_size;
+			infos[l].offset = offset;
+			offset += tile_bytes * infos[l].tiles_x * infos[l].tiles_y;
+		}
+
+		// write the header and the tiles of each level (edge tiles are padded to full size)
+		std::ofstream out(output, std::ios::binary);
+		out.write(file_magic, 8);
+		out.write(reinterpret_cast<const char *>(&tile_size), sizeof(tile_size));
+		out.write(reinterpret_cast<const char *>(&level_count), sizeof(level_count));
+		out.write(reinterpret_cast<const char *>(infos.data()), infos.size() * sizeof(level_info));
+		std::vector<uint8_t> tile(tile_bytes);
+		for (uint32_t l = 0; l < level_count; ++l) {
+			for (uint32_t ty = 0; ty < infos[l].tiles_y; ++ty) {
+				for (uint32_t tx = 0; tx < infos[l].tiles_x; ++tx) {
+					std::fill(tile.begin(), tile.end(), 0);
+					for (uint32_t y = 0; y < tile_size && ty * tile_size + y < infos[l].height; ++y) {
+						auto columns = std::min(tile_size, infos[l].width - tx * tile_size);
+						auto source = (static_cast<size_t>(ty * tile_size + y) * infos[l].width + tx * tile_size) * 3;
+						std::memcpy(&tile[y * tile_size * 3], &levels[l][source], columns * 3);
+					}
+					out.write(reinterpret_cast<const char *>(tile.data()), tile.size());
+				}
+			}
+		}
+		if (!out) {
+			throw std::runtime_error("unable to write " + output);
+		}
+	}
+
+private:
+
+	// description of one mip level as stored in the file
+	struct level_info {
+		uint32_t width;				// width in texels
+		uint32_t height;			// height in texels
+		uint32_t tiles_x;			// number of tile columns
+		uint32_t tiles_y;			// number of tile rows
+		uint64_t offset;			// file offset of the first tile
+	};
+
+	static constexpr char file_magic[8] = { 'R', 'T', 'M', 'I', 'P', '0', '1', '\0' };
+
+	shared_ptr<tile_cache> _cache;			// shared tile cache
+	uint64_t _id;							// identifier distinguishing this texture's tiles in the cache
+	int _fd = -1;							// open file descriptor
+	uint32_t _tile_size = 0;				// tile width and height in texels
+	int _level = 0;							// sampled mip level
+	level_info _level_info{};				// description of the sampled level
+
+	// return a unique identifier for a new texture
+	static uint64_t nextId() {
+		static std::atomic<uint64_t> next{ 0 };
+		return next++;
+	}
+
+	// read bytes from the file at an offset
+	// returns:
+	//   true if every byte was read
+	bool readAt(void *destination, size_t size, uint64_t offset) const {
+		auto bytes = pread(_fd, destination, size, static_cast<off_t>(offset));
+		return bytes == static_cast<ssize_t>(size);
+	}
+
+	// return a texel colour (linear), with coordinates clamped to the image edge
+	// parameters:
+	//   x, y: the texel coordinates
+	//   current, current_index: the most recently fetched tile and its index, updated on a change of tile
+	colour texel(int x, int y, tile_cache::tile &current, uint32_t &current_index) const {
+		auto cx = static_cast<uint32_t>(std::clamp(x, 0, static_cast<int>(_level_info.width) - 1));
+		auto cy = static_cast<uint32_t>(std::clamp(y, 0, static_cast<int>(_level_info.height) - 1));
+		auto index = (cy / _tile_size) * _level_info.tiles_x + (cx / _tile_size);
+		if (index != current_index) {
+			// tiles are keyed by texture, level and tile index
+			auto key = (_id << 40) | (static_cast<uint64_t>(_level) << 32) | index;
+			current = _cache->get(key, [this, index] {
+				auto bytes = static_cast<size_t>(_tile_size) * _tile_size * 3;
+				auto data = std::make_shared<std::vector<uint8_t>>(bytes);
+				// the file was checked when opened, so a failed read is an i/o error while rendering, which must not
+				// throw on a render thread; show the tile in magenta instead
+				if (!readAt(data->data(), bytes, _level_info.offset + static_cast<uint64_t>(index) * bytes)) {
+					for (size_t i = 0; i < bytes; i += 3) {
+						(*data)[i] = 255;
+						(*data)[i + 1] = 0;
+						(*data)[i + 2] = 255;
+					}
+				}
+				return tile_cache::tile(data);
+			});
+			current_index = index;
+		}
+		auto offset = ((cy % _tile_size) * _tile_size + (cx % _tile_size)) * 3;
+		return colour(gammaToLinear((*current)[offset]),
+					  gammaToLinear((*current)[offset + 1]),
+					  gammaToLinear((*current)[offset + 2]));
+	}
+
+	// convert a gamma-encoded 8-bit component to linear (the inverse of linearToGamma)
+	static double gammaToLinear(uint8_t component) {
+		auto value = component / 255.0;
+		return value * value;
+	}
+
+	// halve an image in linear space, rounding odd sizes up (each output texel averages the source texels under its
+	// footprint weighted by coverage, so on an odd side it spans three texels, the outer two partly, and every level
+	// keeps the mean of the image)
+	static std::vector<uint8_t> downsample(const std::vector<uint8_t> &source, uint32_t width, uint32_t height) {
+		auto half_width = halve(width);
+		auto half_height = halve(height);
+		auto columns = footprints(width, half_width);
+		auto rows = footprints(height, half_height);
+		// filter the rows, then the columns
+		std::vector<double> filtered(static_cast<size_t>(half_width) * height * 3, 0.0);
+		for (uint32_t y = 0; y < height; ++y) {
+			for (uint32_t x = 0; x < half_width; ++x) {
+				for (const auto &tap : columns[x]) {
+					for (int c = 0; c < 3; ++c) {
+						filtered[(static_cast<size_t>(y) * half_width + x) * 3 + c] +=
+							tap.second * gammaToLinear(source[(static_cast<size_t>(y) * width + tap.first) * 3 + c]);
+					}
+				}
+			}
+		}
+		std::vector<uint8_t> result(static_cast<size_t>(half_width) * half_height * 3);
+		for (uint32_t y = 0; y < half_height; ++y) {
+			for (uint32_t x = 0; x < half_width; ++x) {
+				for (int c = 0; c < 3; ++c) {
+					auto sum = 0.0;
+					for (const auto &tap : rows[y]) {
+						sum += tap.second * filtered[(static_cast<size_t>(tap.first) * half_width + x) * 3 + c];
+					}
+					result[(static_cast<size_t>(y) * half_width + x) * 3 + c] =
+						static_cast<uint8_t>(round(linearToGamma(sum) * 255.0));
+				}
+			}
+		}
+		return result;
+	}
+
+	// return the size of the next mip level along one side
+	static uint32_t halve(uint32_t size) {
+		return std::max(1u, (size + 1) / 2);
+	}
+
+	// return the source texels and weights covered by each output texel when shrinking one side
+	// parameters:
+	//   size: the source size
+	//   reduced: the output size
+	static std::vector<std::vector<std::pair<uint32_t, double>>> footprints(uint32_t size, uint32_t reduced) {
+		std::vector<std::vector<std::pair<uint32_t, double>>> taps(reduced);
+		auto scale = static_cast<double>(size) / reduced;
+		for (uint32_t i = 0; i < reduced; ++i) {
+			// the output texel covers [i * scale, (i + 1) * scale) of the source
+			auto start = i * scale, end = (i + 1) * scale;
+			for (auto s = static_cast<uint32_t>(std::floor(start)); s < size && s < end; ++s) {
+				auto coverage = std::min<double>(s + 1, end) - std::max<double>(s, start);
+				if (coverage > 1e-12) {
+					taps[i].emplace_back(s, coverage / scale);
+				}
+			}
+		}
+		return taps;
+	}
+
+};
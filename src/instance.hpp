@@ -0,0 +1,60 @@
+#pragma once
+#include "hittable.hpp"
+#include "transform.hpp"
+
+// a class representing a placement of shared geometry with an affine transform
+// (the prototype, eg. a sphere, hittable_list or bvh_node, is referenced rather than copied, so many
+// instances of one prototype cost only a transform each; a bvh_node over instances gives a two-level
+// hierarchy with the top level over placements and the bottom level inside each prototype)
+class instance : public hittable {
+public:
+
+	// constructor to initialise an instance of a prototype
+	// parameters:
+	//   prototype: the shared geometry, in its own object space
+	//   object_to_world: transform placing the prototype in the scene
+	instance(shared_ptr<hittable> prototype, const transform &object_to_world)
+		: _prototype(prototype), _object_to_world(object_to_world), _world_to_object(object_to_world.inverse()) {
+		// bound the transformed corners of the prototype box
+		auto box = _prototype->boundingBox();
+		for (int i = 0; i < 8; ++i) {
+			auto corner = point3((i & 1) ? box.x.max : box.x.min,
+								 (i & 2) ? box.y.max : box.y.min,
+								 (i & 4) ? box.z.max : box.z.min);
+			auto p = _object_to_world.point(corner);
+			_bbox = aabb(_bbox, aabb(p, p));
+		}
+	}
+
+	// check for intersection by transforming the ray into object space
+	// parameters:
+	//   r: the ray
+	//	 ray_t: an interval representing the range of intersection values
+	//   rec: the record containing intersection information
+	// returns:
+	//   true if an intersection matched else false
+	bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+		// transform the ray into object space (the direction is not normalised, so ray distances are unchanged)
+		ray object_ray(_world_to_object.point(r.origin()), _world_to_object.vector(r.direction()), r.time());
+		// check for intersection with the prototype
+		if (!_prototype->hit(object_ray, ray_t, rec)) {
+			return false;
+		}
+		// transform the hit back into world space (normals by the inverse transpose)
+		rec.point = _object_to_world.point(rec.point);
+		rec.normal = unitVector(_world_to_object.transposedVector(rec.normal));
+		// intersection found
+		return true;
+	}
+
+	// return the box enclosing the transformed prototype
+	aabb boundingBox() const override { return _bbox; }
+
+private:
+
+	shared_ptr<hittable> _prototype;		// shared geometry
+	transform _object_to_world;				// object to world space transform
+	transform _world_to_object;				// world to object space transform
+	aabb _bbox;								// box enclosing the transformed prototype
+
+};
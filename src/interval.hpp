@@ -1,5 +1,7 @@
 #pragma once
 #include "common.hpp"
+#include <algorithm>
+#include <cmath>
 
 // a class representing an interval between two values
 class interval {
@@ -16,6 +18,28 @@ public:
 	interval(double _min, double _max)
 		: min(_min), max(_max) { }
 
+	// constructor to initialise interval tightly enclosing two intervals
+	// parameters:
+	//   a: the first interval
+	//   b: the second interval
+	interval(const interval &a, const interval &b)
+		: min(fmin(a.min, b.min)), max(fmax(a.max, b.max)) { }
+
+	// return the size of the interval
+	double size() const {
+		return max - min;
+	}
+
+	// return an interval padded by delta (half on each side)
+	// parameters:
+	//   delta: total amount to pad the interval by
+	// returns:
+	//   the expanded interval
+	interval expand(double delta) const {
+		auto padding = delta / 2;
+		return interval(min - padding, max + padding);
+	}
+
   	// check if interval contains a specific value
 	bool contains(double x) const {
 		return min <= x && x <= max;
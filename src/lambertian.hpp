@@ -1,14 +1,20 @@
 #pragma once
 #include "material.hpp"
+#include "texture.hpp"
 
 // a derived class representing a diffuse material
 class lambertian : public material {
 public:
 
-	// constructor to initialise the diffuse material
+	// constructor to initialise the diffuse material with a constant colour
 	// parameters:
 	//   a: the albedo colour of the surface
-	lambertian(const colour &a) : _albedo(a) {}
+	lambertian(const colour &a) : _albedo(make_shared<solid_colour>(a)) {}
+
+	// constructor to initialise the diffuse material with a texture
+	// parameters:
+	//   a: the albedo texture of the surface
+	lambertian(shared_ptr<texture> a) : _albedo(a) {}
 
 	// scatter function for simulating interaction between a ray and a material
 	// parameters:
@@ -26,15 +32,28 @@ public:
 			scatter_direction = rec.normal;
 		}
 		// create the scattered ray
-		scattered = ray(rec.point, scatter_direction);
-		// set attenuation to the material's albedo
-		attenuation = _albedo;
+		scattered = ray(rec.point, scatter_direction, r_in.time());
+		// set attenuation to the material's albedo at the hit point
+		attenuation = _albedo->value(rec.u, rec.v, rec.point);
 		// always scatters
 		return true;
 	}
 
+	// return the albedo at the hit point
+	colour albedo(const hit_record &rec) const override {
+		return _albedo->value(rec.u, rec.v, rec.point);
+	}
+
+	// return the albedo texture
+	shared_ptr<texture> albedoTexture() const { return _albedo; }
+
+	// change the albedo to a constant colour (not while rendering)
+	// parameters:
+	//   a: the albedo colour of the surface
+	void setAlbedo(const colour &a) { _albedo = make_shared<solid_colour>(a); }
+
 private:
 
-	colour _albedo;		// the albedo colour of the surface
+	shared_ptr<texture> _albedo;		// the albedo texture of the surface
 
 };
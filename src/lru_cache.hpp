@@ -0,0 +1,123 @@
+#pragma once
+#include "common.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// weighs every cached value as one entry, so the capacity is a number of entries
+struct unit_weight {
+	template <typename Value>
+	size_t operator()(const Value &) const { return 1; }
+};
+
+// a class representing a bounded, least recently used cache shared between threads
+// (the keys are split between independently locked shards, each holding an equal share of the capacity, so
+// threads rarely wait on each other; values are loaded without holding a lock and should be cheap to copy, eg.
+// shared pointers, so a lookup can keep using a value after it is evicted)
+template <typename Value, typename Weight = unit_weight>
+class lru_cache {
+public:
+
+	// constructor to initialise the cache
+	// parameters:
+	//   capacity: the maximum total weight held at once (each shard keeps at least its most recent value)
+	//   shard_count: the number of independently locked shards
+	//   weight: returns the weight of a value
+	lru_cache(size_t capacity, size_t shard_count = 1, Weight weight = Weight())
+		: _shards(std::max<size_t>(1, shard_count)), _weight(weight) {
+		for (auto &s : _shards) {
+			s.capacity = std::max<size_t>(1, capacity / _shards.size());
+		}
+	}
+
+	// return a value, loading it on a miss and evicting the least recently used values to stay within capacity
+	// parameters:
+	//   key: a key unique to the value
+	//   load: function returning the value (called without holding the cache lock)
+	// returns:
+	//   the value
+	template <typename Load>
+	Value get(uint64_t key, const Load &load) {
+		// scramble the key so consecutive keys spread over the shards
+		auto &s = _shards[_shards.size() == 1 ? 0 : mixBits(key) % _shards.size()];
+		{
+			std::lock_guard<std::mutex> lock(s.mutex);
+			auto found = s.entries.find(key);
+			if (found != s.entries.end()) {
+				// move to the front of the recently used list
+				s.order.splice(s.order.begin(), s.order, found->second.position);
+				++s.hits;
+				return found->second.value;
+			}
+			++s.misses;
+		}
+		// load outside the lock so other threads keep working
+		Value value = load();
+		std::lock_guard<std::mutex> lock(s.mutex);
+		// another thread may have loaded the same value meanwhile
+		auto found = s.entries.find(key);
+		if (found != s.entries.end()) {
+			return found->second.value;
+		}
+		s.order.push_front(key);
+		s.entries.emplace(key, entry{ value, s.order.begin() });
+		s.size += _weight(value);
+		// evict from the back of the list
+		while (s.size > s.capacity && s.order.size() > 1) {
+			auto evicted = s.entries.find(s.order.back());
+			s.size -= _weight(evicted->second.value);
+			s.entries.erase(evicted);
+			s.order.pop_back();
+		}
+		return value;
+	}
+
+	// return the total weight currently cached
+	size_t size() const { return statistic([](const shard &s) { return s.size; }); }
+
+	// return the number of values currently cached
+	size_t count() const { return statistic([](const shard &s) { return s.entries.size(); }); }
+
+	// return the number of lookups served from the cache
+	size_t hits() const { return statistic([](const shard &s) { return s.hits; }); }
+
+	// return the number of lookups that loaded a value
+	size_t misses() const { return statistic([](const shard &s) { return s.misses; }); }
+
+private:
+
+	// a cached value and its position in the recently used list
+	struct entry {
+		Value value;
+		std::list<uint64_t>::iterator position;
+	};
+
+	// one independently locked part of the cache
+	struct shard {
+		mutable std::mutex mutex;						// guards every member below
+		size_t capacity = 1;							// maximum weight held
+		size_t size = 0;								// weight currently held
+		size_t hits = 0;								// lookups served from the cache
+		size_t misses = 0;								// lookups that loaded a value
+		std::list<uint64_t> order;						// keys, most recently used first
+		std::unordered_map<uint64_t, entry> entries;	// cached values by key
+	};
+
+	std::vector<shard> _shards;							// shards, picked by a hash of the key
+	Weight _weight;										// returns the weight of a value
+
+	// sum a statistic over the shards
+	template <typename Statistic>
+	size_t statistic(const Statistic &value) const {
+		size_t total = 0;
+		for (const auto &s : _shards) {
+			std::lock_guard<std::mutex> lock(s.mutex);
+			total += value(s);
+		}
+		return total;
+	}
+
+};
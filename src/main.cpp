@@ -1,51 +1,72 @@
+#include "benchmark.hpp"
+#include "bvh.hpp"
 #include "camera.hpp"
 #include "colour.hpp"
 #include "dielectric.hpp"
+#include "image_texture.hpp"
+#include "instance.hpp"
 #include "lambertian.hpp"
 #include "metal.hpp"
+#include "procedural_grid.hpp"
+#include "render_server.hpp"
+#include <string>
 
-int main() {
+// fill one cell of the example scene's grid with a small sphere
+// parameters:
+//   corner: the lower corner of the cell
+//   cell: receives the cell's sphere (within 0.2 of the cell)
+void generateCell(const point3 &corner, hittable_list &cell) {
 
-	// create world
-	hittable_list scene;
+	// randomly select material for the sphere
+	auto material_selector = randomDouble();
+	point3 centre(corner.x() + 0.9 * randomDouble(), 0.2, corner.z() + 0.9 * randomDouble());
 
-	// add ground to scene
-	auto ground_material = make_shared<lambertian>(colour(0.5, 0.5, 0.5));
-	scene.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+	// keep clear of the large spheres
+	if ((centre - point3(4, 0.2, 0)).length() > 0.9) {
 
-	// add small spheres to scene
-	for (int a = -11; a < 11; a++) {
-		for (int b = -11; b < 11; b++) {
-
-			// randomly select material for each sphere
-			auto material_selector = randomDouble();
-			point3 centre(a + 0.9 * randomDouble(), 0.2, b + 0.9 * randomDouble());
-
-			if ((centre - point3(4, 0.2, 0)).length() > 0.9) {
-
-				shared_ptr<material> sphere_material;
-
-				if (material_selector < 0.8) {
-					// diffuse
-					auto albedo = colour::random() * colour::random();
-					sphere_material = make_shared<lambertian>(albedo);
-					scene.add(make_shared<sphere>(centre, 0.2, sphere_material));
-				} else if (material_selector < 0.95) {
-					// metal
-					auto albedo = colour::random(0.5, 1);
-					auto fuzz = randomDouble(0, 0.5);
-					sphere_material = make_shared<metal>(albedo, fuzz);
-					scene.add(make_shared<sphere>(centre, 0.2, sphere_material));
-				} else {
-					// glass
-					sphere_material = make_shared<dielectric>(1.5);
-					scene.add(make_shared<sphere>(centre, 0.2, sphere_material));
-				}
-			}
+		shared_ptr<material> sphere_material;
 
+		if (material_selector < 0.8) {
+			// diffuse (bouncing upwards while the shutter is open)
+			auto albedo = colour::random() * colour::random();
+			sphere_material = make_shared<lambertian>(albedo);
+			auto centre_end = centre + vec3(0, randomDouble(0, 0.5), 0);
+			cell.add(make_shared<sphere>(centre, centre_end, 0.2, sphere_material));
+		} else if (material_selector < 0.95) {
+			// metal
+			auto albedo = colour::random(0.5, 1);
+			auto fuzz = randomDouble(0, 0.5);
+			sphere_material = make_shared<metal>(albedo, fuzz);
+			cell.add(make_shared<sphere>(centre, 0.2, sphere_material));
+		} else {
+			// glass
+			sphere_material = make_shared<dielectric>(1.5);
+			cell.add(make_shared<sphere>(centre, 0.2, sphere_material));
 		}
 	}
 
+}
+
+// create the grid of small spheres of the example scene, generating cells lazily
+// parameters:
+//   cells: the number of cells along each side (the example scene uses 22)
+//   seed: the seed of the field
+// returns:
+//   the grid, centred on the origin
+shared_ptr<procedural_grid> sphereGrid(int64_t cells, uint64_t seed) {
+	return make_shared<procedural_grid>(point3(-cells / 2, 0, -cells / 2), vec3(1, 1, 1), std::array<int64_t, 3>{ cells, 1, cells },
+										0.2, generateCell, seed);
+}
+
+// add the ground and the three large spheres of the example scene
+// parameters:
+//   scene: the scene to add to
+void addLandmarks(hittable_list &scene) {
+
+	// add ground to scene
+	auto ground_material = make_shared<lambertian>(colour(0.5, 0.5, 0.5));
+	scene.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_material));
+
 	// add three large spheres to scene
 	auto material_a = make_shared<dielectric>(1.5);
 	scene.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material_a));
@@ -56,6 +77,73 @@ int main() {
 	auto material_c = make_shared<metal>(colour(0.7, 0.6, 0.5), 0.0);
 	scene.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material_c));
 
+}
+
+// build the example scene
+// returns:
+//   the scene, wrapped in a bounding volume hierarchy
+shared_ptr<hittable> buildScene() {
+
+	// create world
+	hittable_list scene;
+	addLandmarks(scene);
+
+	// add small spheres to scene, all generated up front
+	auto small_spheres = sphereGrid(22, randomGenerator()())->eager();
+	for (const auto &object : small_spheres.objects) {
+		scene.add(object);
+	}
+
+	// build bounding volume hierarchy over the scene
+	return make_shared<bvh_node>(scene);
+
+}
+
+// build the example scene with a field of small spheres generated as rays reach them
+// parameters:
+//   cells: the number of cells along each side of the field
+//   seed: the seed of the field
+// returns:
+//   the scene and its field
+std::pair<shared_ptr<hittable>, shared_ptr<procedural_grid>> buildLazyScene(int64_t cells, uint64_t seed) {
+	hittable_list scene;
+	addLandmarks(scene);
+	auto grid = sphereGrid(cells, seed);
+	scene.add(grid);
+	return { make_shared<bvh_node>(scene), grid };
+}
+
+// build the example scene with its small spheres replaced by placements of one shared cluster of spheres
+// parameters:
+//   count: the number of placements along each side of the field
+// returns:
+//   the scene, wrapped in a bounding volume hierarchy
+shared_ptr<hittable> buildInstancedScene(int count) {
+	hittable_list scene;
+	addLandmarks(scene);
+	// one cluster of spheres in the unit cube, shared by every placement
+	hittable_list cluster;
+	for (int i = 0; i < 16; ++i) {
+		auto albedo = colour::random() * colour::random();
+		cluster.add(make_shared<sphere>(point3(randomDouble(0.1, 0.9), randomDouble(0.1, 0.3), randomDouble(0.1, 0.9)), 0.08,
+										make_shared<lambertian>(albedo)));
+	}
+	shared_ptr<hittable> prototype = make_shared<bvh_node>(cluster);
+	// place the cluster on a grid, each turned about the vertical and scaled
+	for (int x = 0; x < count; ++x) {
+		for (int z = 0; z < count; ++z) {
+			auto placement = transform::translation(vec3(x - count / 2.0, 0, z - count / 2.0)) *
+							 transform::rotation(vec3(0, 1, 0), randomDouble(0, 360)) *
+							 transform::scaling(vec3(1, randomDouble(0.5, 1.5), 1));
+			scene.add(make_shared<instance>(prototype, placement));
+		}
+	}
+	return make_shared<bvh_node>(scene);
+}
+
+// create the camera used for the example scene
+camera defaultCamera() {
+
 	// create camera
 	camera camera;
 	// override camera defaults
@@ -69,8 +157,276 @@ int main() {
 	camera.v_up = vec3(0, 1, 0);
 	camera.defocus_angle = 0.6;
 	camera.focus_distance = 10.0;
+	camera.shutter_open = 0.0;
+	camera.shutter_close = 1.0;
+	return camera;
+
+}
+
+// build the example scene with a checkered ground and its large spheres wrapped in a tiled image
+// parameters:
+//   tiled: path of a tiled image written by image_texture::convertPpm
+//   cache: the tile cache shared by the image textures
+// returns:
+//   the scene, wrapped in a bounding volume hierarchy
+shared_ptr<hittable> buildTexturedScene(const std::string &tiled, shared_ptr<tile_cache> cache) {
+	hittable_list scene;
+	auto checker = make_shared<checker_texture>(0.5, colour(0.2, 0.3, 0.1), colour(0.9, 0.9, 0.9));
+	scene.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+	// full resolution in the middle, a coarse mip level (touching few tiles) on the left
+	scene.add(make_shared<sphere>(point3(0, 1, 0), 1.0, make_shared<lambertian>(make_shared<image_texture>(tiled, cache))));
+	scene.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, make_shared<lambertian>(make_shared<image_texture>(tiled, cache, 3))));
+	scene.add(make_shared<sphere>(point3(4, 1, 0), 1.0, make_shared<metal>(colour(0.7, 0.6, 0.5), 0.0)));
+	auto small_spheres = sphereGrid(22, randomGenerator()())->eager();
+	for (const auto &object : small_spheres.objects) {
+		scene.add(object);
+	}
+	return make_shared<bvh_node>(scene);
+}
+
+// usage:
+//   main                                    render the example scene to standard output
+//   main --serve <socket>                   keep the scene resident and render jobs sent to the socket
+//   main --request <socket> key=value...    send one request to a server and print the reply
+//   main --benchmark                        compare numa replicas with one shared scene
+//   main --denoise [spp]                    render the example scene to standard output, then denoise it
+//   main --denoise-check                    check denoising lowers the error against a 512 spp reference at 16,
+//                                           32 and 64 spp
+//   main --stream <file> [width] [mb]       render in bands to a binary ppm file within a memory budget
+//   main --numa                             render with a scene replica per numa node and pinned threads
+//   main --guiding                          compare path guiding with the plain integrator at equal time
+//   main --incremental <prefix>             render, edit one material and the exposure, re-rendering only the
+//                                           affected pixels, writing <prefix>_0.ppm to <prefix>_2.ppm
+//   main --procedural [cells]               check the lazy sphere field against the eager scene, then render a
+//                                           field of cells x cells spheres generated as rays reach them
+//   main --mesh <prefix> [segments]         check malformed obj files are rejected, write a tessellated sphere to
+//                                           <prefix>.obj and <prefix>.ply, time loading both, then render the mesh
+//                                           in the example scene to <prefix>.ppm
+//   main --instances [count]                render count x count placements of one shared cluster of spheres
+//   main --texture <ppm> [cache kb]         convert a ppm to a tiled, mip-mapped <ppm>.tiled and render the example
+//                                           scene textured with it through a tile cache of the given size
+//   main --compact [cells]                  compare the memory and speed of sphere objects with compact sphere
+//                                           storage on a field of cells x cells spheres
+int main(int argc, char *argv[]) {
+
+	auto mode = argc > 1 ? std::string(argv[1]) : std::string();
+
+	// client mode, no scene needed
+	if (mode == "--request" && argc > 2) {
+		std::string request;
+		for (int i = 3; i < argc; ++i) {
+			request += std::string(argv[i]) + "\n";
+		}
+		std::cout << render_server::request(argv[2], request);
+		return 0;
+	}
+
+	// lazily generated sphere field
+	if (mode == "--procedural") {
+		// the lazy field must match the eagerly built scene ray for ray
+		auto seed = randomGenerator()();
+		auto lazy = buildLazyScene(22, seed).first;
+		hittable_list eager;
+		addLandmarks(eager);
+		auto small_spheres = sphereGrid(22, seed)->eager();
+		for (const auto &object : small_spheres.objects) {
+			eager.add(object);
+		}
+		bvh_node eager_scene(eager);
+		int mismatches = 0;
+		const int rays = 200000;
+		for (int i = 0; i < rays; ++i) {
+			ray r(point3(randomDouble(-15, 15), randomDouble(0.1, 4), randomDouble(-15, 15)), randomUnitVector(), randomDouble());
+			hit_record a, b;
+			auto hit_a = lazy->hit(r, interval(0.001, infinity), a);
+			auto hit_b = eager_scene.hit(r, interval(0.001, infinity), b);
+			if (hit_a != hit_b || (hit_a && (a.distance != b.distance || typeid(*a.material) != typeid(*b.material) ||
+											 a.material->albedo(a)[0] != b.material->albedo(b)[0]))) {
+				++mismatches;
+			}
+		}
+		std::clog << "Lazy and eager scenes differ on " << mismatches << " of " << rays << " rays\n";
+		// render a large field
+		auto cells = argc > 2 ? std::stoll(argv[2]) : 10000;
+		auto [scene, grid] = buildLazyScene(cells, seed);
+		defaultCamera().render(*scene);
+		std::clog << "Field of " << cells * cells << " cells: " << grid->cachedCells() << " cached, " << grid->cacheMisses()
+				  << " generated, " << grid->cacheHits() << " cache hits\n";
+		return 0;
+	}
+
+	// mesh loading benchmark, then a render with the loaded mesh
+	if (mode == "--mesh" && argc > 2) {
+		std::string prefix = argv[2];
+		if (!checkMeshLoading(prefix)) {
+			return 1;
+		}
+		std::printf("\n");
+		benchmarkMeshLoading(prefix, argc > 3 ? std::stoi(argv[3]) : 1000);
+		hittable_list scene;
+		addLandmarks(scene);
+		auto mesh = mesh_loader::load(prefix + ".ply", make_shared<metal>(colour(0.8, 0.85, 0.9), 0.05), true);
+		scene.add(make_shared<instance>(mesh, transform::translation(vec3(2, 1, 2.5))));
+		std::ofstream image(prefix + ".ppm");
+		defaultCamera().render(bvh_node(scene), image);
+		return 0;
+	}
+
+	// instanced scene
+	if (mode == "--instances") {
+		auto count = argc > 2 ? std::stoi(argv[2]) : 22;
+		defaultCamera().render(*buildInstancedScene(count));
+		std::clog << count * count << " placements of one 16-sphere cluster: " << count * count * sizeof(instance)
+				  << " bytes of instances in place of " << count * count * 16 * sizeof(sphere) << " bytes of copied spheres\n";
+		return 0;
+	}
+
+	// tiled image textures under a fixed tile cache budget
+	if (mode == "--texture" && argc > 2) {
+		std::string tiled = std::string(argv[2]) + ".tiled";
+		image_texture::convertPpm(argv[2], tiled);
+		auto budget = static_cast<size_t>(argc > 3 ? std::stoll(argv[3]) : 128) << 10;
+		auto cache = make_shared<tile_cache>(budget);
+		// the coarsest level must keep the mean of the full image
+		image_texture full(tiled, cache), coarsest(tiled, cache, 64);
+		colour mean(0, 0, 0);
+		for (uint32_t y = 0; y < full.height(); ++y) {
+			for (uint32_t x = 0; x < full.width(); ++x) {
+				mean += full.value((x + 0.5) / full.width(), 1 - (y + 0.5) / full.height(), point3());
+			}
+		}
+		mean = mean / (static_cast<double>(full.width()) * full.height());
+		auto texel = coarsest.value(0.5, 0.5, point3());
+		std::clog << "Image mean (" << mean[0] << ", " << mean[1] << ", " << mean[2] << "), " << coarsest.width() << "x"
+				  << coarsest.height() << " mip (" << texel[0] << ", " << texel[1] << ", " << texel[2] << ")\n";
+		defaultCamera().render(*buildTexturedScene(tiled, cache));
+		std::clog << "Tile cache of " << (budget >> 10) << " KB: " << cache->size() << " bytes held, " << cache->misses()
+				  << " tile reads, " << cache->hits() << " hits\n";
+		return 0;
+	}
+
+	// compact scene storage, at a reduced render size
+	if (mode == "--compact") {
+		auto cells = argc > 2 ? std::stoll(argv[2]) : 200;
+		hittable_list spheres;
+		addLandmarks(spheres);
+		auto small_spheres = sphereGrid(cells, randomGenerator()())->eager();
+		for (const auto &object : small_spheres.objects) {
+			spheres.add(object);
+		}
+		auto camera = defaultCamera();
+		camera.image_width = 200;
+		camera.samples_per_pixel = 8;
+		benchmarkCompactScene(spheres.objects, camera);
+		return 0;
+	}
+
+	// build scene once
+	auto scene = buildScene();
+	auto camera = defaultCamera();
+
+	// benchmark mode, at a reduced size
+	if (mode == "--benchmark") {
+		camera.image_width = 200;
+		camera.samples_per_pixel = 8;
+		benchmarkNuma(buildScene, camera, numa_topology());
+		return 0;
+	}
+
+	// denoised render
+	if (mode == "--denoise") {
+		if (argc > 2) {
+			camera.samples_per_pixel = std::stoi(argv[2]);
+		}
+		camera.denoise = true;
+		camera.render(*scene);
+		return 0;
+	}
+
+	// denoiser check, at a reduced size
+	if (mode == "--denoise-check") {
+		camera.image_width = 160;
+		return benchmarkDenoiser(*scene, camera, { 16, 32, 64 }, 512) ? 0 : 1;
+	}
+
+	// streaming mode, for images too large to hold in memory
+	if (mode == "--stream" && argc > 2) {
+		if (argc > 3) {
+			camera.image_width = std::stoi(argv[3]);
+		}
+		if (argc > 4) {
+			camera.memory_budget = std::stoull(argv[4]) << 20;
+		}
+		return camera.renderToFile(*scene, argv[2]) ? 0 : 1;
+	}
+
+	// numa mode, replicating the scene on each node
+	if (mode == "--numa") {
+		numa_topology topology;
+		numa_scene replicas(topology, buildScene);
+		camera.numa = &topology;
+		camera.render(replicas);
+		return 0;
+	}
+
+	// path guiding comparison, at a reduced size, in the open and under a low ceiling lit only from the horizon
+	if (mode == "--guiding") {
+		camera.image_width = 200;
+		camera.samples_per_pixel = 32;
+		camera.defocus_angle = 0;
+		std::printf("open sky\n");
+		compareGuiding(*scene, camera, 1024);
+		hittable_list covered(scene);
+		covered.add(make_shared<sphere>(point3(0, 1003, 0), 1000, make_shared<lambertian>(colour(0.8, 0.8, 0.8))));
+		std::printf("\nlow ceiling\n");
+		compareGuiding(covered, camera, 1024);
+		return 0;
+	}
+
+	// incremental re-render after edits
+	if (mode == "--incremental" && argc > 2) {
+		std::string prefix = argv[2];
+		auto start = std::chrono::steady_clock::now();
+		auto cache = camera.renderCached(*scene);
+		auto full = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::ofstream original(prefix + "_0.ppm");
+		cache.write(original);
+		// edit the albedo of the large diffuse sphere, found by dropping a ray onto it from above
+		hit_record record;
+		if (!scene->hit(ray(point3(-4, 3, 0), vec3(0, -1, 0)), interval(0.001, infinity), record)) {
+			return 1;
+		}
+		auto diffuse = dynamic_cast<lambertian *>(record.material.get());
+		if (diffuse == nullptr) {
+			return 1;
+		}
+		diffuse->setAlbedo(colour(0.1, 0.2, 0.5));
+		start = std::chrono::steady_clock::now();
+		auto rerendered = camera.rerenderCached(*scene, cache, { record.material.get() });
+		auto partial = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::ofstream edited(prefix + "_1.ppm");
+		cache.write(edited);
+		// an exposure edit only rewrites the image
+		std::ofstream exposed(prefix + "_2.ppm");
+		cache.write(exposed, 1.5);
+		auto total = cache.pixels.size();
+		std::clog << "Full render: " << total << " pixels in " << full << " s\n"
+				  << "Material edit: re-rendered " << rerendered << " pixels in " << partial << " s, skipped "
+				  << total - rerendered << " (" << 100.0 * (total - rerendered) / total << "%)\n"
+				  << "Exposure edit: re-rendered 0 pixels, skipped " << total << " (100%)\n"
+				  << "Touch records: " << cache.touchBytes() << " bytes\n";
+		return 0;
+	}
+
+	// server mode
+	if (mode == "--serve" && argc > 2) {
+		render_server server(scene, camera);
+		server.run(argv[2]);
+		return 0;
+	}
+
 	// render
-	camera.render(scene);
+	camera.render(*scene);
 
 	// successful execution
 	return 0;
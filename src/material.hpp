@@ -15,6 +15,15 @@ public:
 	//   true if scattering occurs (ray is absorbed and/or redirected), else false
 	virtual bool scatter(const ray &r_in, const hit_record &rec, colour &attenuation, ray &scattered) const = 0;
 
+	// surface colour at a hit point, recorded in the albedo feature buffer
+	// parameters:
+	//   the record containing intersection information (not used by the default)
+	// returns:
+	//   the albedo (white unless overridden)
+	virtual colour albedo(const hit_record &) const {
+		return colour(1, 1, 1);
+	}
+
 	// destructor to ensure cleanup in derived classes
 	virtual ~material() = default;
 
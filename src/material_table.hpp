@@ -0,0 +1,159 @@
+#pragma once
+#include "dielectric.hpp"
+#include "lambertian.hpp"
+#include "metal.hpp"
+#include <algorithm>
+#include <cstring>
+#include <typeindex>
+#include <vector>
+
+// a class representing a table of materials in which equal materials are stored once (hash-consing)
+// (built-in materials with a constant albedo are compared by value, so every lambertian of one colour shares an
+// entry; other materials, and textured ones, are compared by identity; an in-place edit such as lambertian::setAlbedo
+// therefore changes every object sharing the entry)
+class material_table {
+public:
+
+	// add a material, returning the index of an equal material already in the table or of the new entry
+	// parameters:
+	//   m: the material
+	// returns:
+	//   the material's index
+	uint32_t intern(const shared_ptr<material> &m) {
+		++_interned;
+		// keep the slots at most half full, so probe runs stay short
+		if (2 * (_materials.size() + 1) > _slots.size()) {
+			rehash(std::max<size_t>(16, 2 * _slots.size()));
+		}
+		// compare against the stored materials along the probe run, rather than storing every key
+		auto k = describe(m);
+		auto mask = _slots.size() - 1;
+		auto slot = key_hash()(k) & mask;
+		for (; _slots[slot] != 0; slot = (slot + 1) & mask) {
+			if (describe(_materials[_slots[slot] - 1]) == k) {
+				return _slots[slot] - 1;
+			}
+		}
+		auto index = static_cast<uint32_t>(_materials.size());
+		_slots[slot] = index + 1;
+		_materials.push_back(m);
+		return index;
+	}
+
+	// return the material at an index
+	const shared_ptr<material> &operator[](uint32_t index) const { return _materials[index]; }
+
+	// return the number of distinct materials stored
+	size_t size() const { return _materials.size(); }
+
+	// return the number of materials added, counting repeats
+	size_t interned() const { return _interned; }
+
+	// return an estimate of the bytes held by the table and its materials
+	size_t bytes() const {
+		// each entry holds a pointer, between two and four slots and a material
+		size_t total = _materials.capacity() * sizeof(shared_ptr<material>) + _slots.capacity() * sizeof(uint32_t);
+		for (const auto &m : _materials) {
+			total += materialBytes(*m);
+		}
+		return total;
+	}
+
+	// return an estimate of the heap bytes held by one material, with its control block (and albedo texture)
+	static size_t materialBytes(const material &m) {
+		if (dynamic_cast<const lambertian *>(&m) != nullptr) {
+			return sizeof(lambertian) + sizeof(solid_colour) + 32;
+		}
+		if (dynamic_cast<const metal *>(&m) != nullptr) {
+			return sizeof(metal) + sizeof(solid_colour) + 32;
+		}
+		if (dynamic_cast<const dielectric *>(&m) != nullptr) {
+			return sizeof(dielectric) + 16;
+		}
+		return sizeof(material) + 16;
+	}
+
+private:
+
+	// the value compared when interning: type, albedo and parameter, or identity for anything else
+	struct key {
+		std::type_index type;
+		double albedo[3] = { 0, 0, 0 };
+		double parameter = 0;
+		const material *identity = nullptr;
+
+		bool operator==(const key &other) const {
+			return type == other.type && albedo[0] == other.albedo[0] && albedo[1] == other.albedo[1] &&
+				   albedo[2] == other.albedo[2] && parameter == other.parameter && identity == other.identity;
+		}
+	};
+
+	// hash a key from its fields (fnv-1a over 64-bit words)
+	struct key_hash {
+		size_t operator()(const key &k) const {
+			uint64_t words[6];
+			std::memcpy(&words[0], &k.albedo[0], sizeof(double) * 3);
+			std::memcpy(&words[3], &k.parameter, sizeof(double));
+			words[4] = static_cast<uint64_t>(k.type.hash_code());
+			words[5] = reinterpret_cast<uintptr_t>(k.identity);
+			uint64_t h = 1469598103934665603ull;
+			for (auto w : words) {
+				h = (h ^ w) * 1099511628211ull;
+				h ^= h >> 29;
+			}
+			return static_cast<size_t>(h);
+		}
+	};
+
+	std::vector<shared_ptr<material>> _materials;		// distinct materials
+	std::vector<uint32_t> _slots;						// open-addressed index + 1 of each distinct material by hash of its key (0 if empty)
+	size_t _interned = 0;								// materials added, counting repeats
+
+	// resize the slots (a power of two) and reinsert every material
+	void rehash(size_t size) {
+		std::vector<uint32_t>(size, 0).swap(_slots);
+		auto mask = size - 1;
+		for (uint32_t index = 0; index < _materials.size(); ++index) {
+			auto slot = key_hash()(describe(_materials[index])) & mask;
+			while (_slots[slot] != 0) {
+				slot = (slot + 1) & mask;
+			}
+			_slots[slot] = index + 1;
+		}
+	}
+
+	// build the key of a material
+	static key describe(const shared_ptr<material> &m) {
+		std::type_index type(typeid(*m));
+		key k{ type };
+		auto solid = [&](const shared_ptr<texture> &t) {
+			if (std::dynamic_pointer_cast<solid_colour>(t) == nullptr) {
+				return false;
+			}
+			auto c = t->value(0, 0, point3());
+			k.albedo[0] = c[0];
+			k.albedo[1] = c[1];
+			k.albedo[2] = c[2];
+			return true;
+		};
+		// only the built-in types themselves, a derived material may hold more state
+		if (type == typeid(lambertian)) {
+			if (solid(static_cast<const lambertian &>(*m).albedoTexture())) {
+				return k;
+			}
+		} else if (type == typeid(metal)) {
+			if (solid(static_cast<const metal &>(*m).albedoTexture())) {
+				k.parameter = static_cast<const metal &>(*m).fuzz();
+				return k;
+			}
+		} else if (type == typeid(dielectric)) {
+			k.parameter = static_cast<const dielectric &>(*m).refractionIndex();
+			return k;
+		}
+		// compare anything else by identity
+		key identity{ type };
+		identity.identity = m.get();
+		return identity;
+	}
+
+};
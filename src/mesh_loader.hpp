@@ -0,0 +1,608 @@
+#pragma once
+#include "triangle_mesh.hpp"
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// a class representing a read-only memory-mapped file
+class mapped_file {
+public:
+
+	// constructor to map a whole file into memory
+	// parameters:
+	//   path: path of the file
+	mapped_file(const std::string &path) {
+		auto fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("unable to open " + path);
+		}
+		struct stat info;
+		if (fstat(fd, &info) != 0) {
+			close(fd);
+			throw std::runtime_error("unable to stat " + path);
+		}
+		_size = static_cast<size_t>(info.st_size);
+		if (_size > 0) {
+			auto address = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (address == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error("unable to map " + path);
+			}
+			_data = static_cast<const char *>(address);
+			// the file is parsed front to back
+			madvise(address, _size, MADV_SEQUENTIAL);
+		}
+		close(fd);
+	}
+
+	// destructor to unmap the file
+	~mapped_file() {
+		if (_data != nullptr) {
+			munmap(const_cast<char *>(_data), _size);
+		}
+	}
+
+	mapped_file(const mapped_file &) = delete;
+	mapped_file &operator=(const mapped_file &) = delete;
+
+	// return the start of the mapped bytes
+	const char *data() const { return _data; }
+
+	// return the size of the file in bytes
+	size_t size() const { return _size; }
+
+private:
+
+	const char *_data = nullptr;			// mapped file contents
+	size_t _size = 0;						// size of the file in bytes
+
+};
+
+// a class that loads triangle meshes from wavefront obj and stanford ply files
+class mesh_loader {
+public:
+
+	// load a mesh, choosing the format from the file extension
+	// parameters:
+	//   path: path of the .obj or .ply file
+	//   material: the material of the mesh
+	//   smooth: interpolate vertex normals
+	//   threads: number of parser threads (0 uses every hardware thread)
+	// returns:
+	//   the mesh
+	static shared_ptr<triangle_mesh> load(const std::string &path, shared_ptr<material> material,
+										  bool smooth = false, unsigned threads = 0) {
+		std::vector<float> positions;
+		std::vector<uint32_t> indices;
+		mapped_file file(path);
+		if (path.ends_with(".obj")) {
+			parseObj(file.data(), file.size(), positions, indices, threads);
+		} else if (path.ends_with(".ply")) {
+			parsePly(file.data(), file.size(), positions, indices, threads);
+		} else {
+			throw std::runtime_error("unsupported mesh format " + path);
+		}
+		return make_shared<triangle_mesh>(std::move(positions), std::move(indices), material, smooth);
+	}
+
+	// parse obj text, splitting it into line-aligned chunks parsed in parallel
+	// (only positions and faces are read, polygons are fan triangulated)
+	// parameters:
+	//   data, size: the file contents
+	//   positions, indices: filled with the mesh buffers
+	//   threads: number of parser threads (0 uses every hardware thread)
+	static void parseObj(const char *data, size_t size, std::vector<float> &positions,
+						 std::vector<uint32_t> &indices, unsigned threads = 0) {
+		// split the file at line boundaries, with enough text per chunk to be worth a thread
+		threads = threadCount(threads, size);
+		std::vector<size_t> bounds{ 0 };
+		for (unsigned c = 1; c < threads; ++c) {
+			auto split = std::max(bounds.back(), size * c / threads);
+			while (split < size && data[split - 1] != '\n') {
+				++split;
+			}
+			bounds.push_back(split);
+		}
+		bounds.push_back(size);
+
+		// parse each chunk independently
+		std::vector<obj_chunk> chunks(bounds.size() - 1);
+		std::vector<std::thread> workers;
+		for (size_t c = 0; c < chunks.size(); ++c) {
+			workers.emplace_back([&, c] {
+				// keep any error for the calling thread
+				try {
+					parseObjChunk(data + bounds[c], data + bounds[c + 1], chunks[c]);
+				} catch (...) {
+					chunks[c].error = std::current_exception();
+				}
+			});
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		for (const auto &chunk : chunks) {
+			if (chunk.error) {
+				std::rethrow_exception(chunk.error);
+			}
+		}
+
+		// calculate where each chunk's output starts in the merged buffers
+		std::vector<size_t> vertex_offsets{ 0 }, index_offsets{ 0 };
+		for (const auto &chunk : chunks) {
+			vertex_offsets.push_back(vertex_offsets.back() + chunk.positions.size() / 3);
+			index_offsets.push_back(index_offsets.back() + chunk.indices.size());
+		}
+		positions.resize(3 * vertex_offsets.back());
+		indices.resize(index_offsets.back());
+
+		// merge chunks in parallel, resolving relative indices against the vertices before each chunk
+		workers.clear();
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		for (size_t c = 0; c < chunks.size(); ++c) {
+			workers.emplace_back([&, c] {
+				const auto &chunk = chunks[c];
+				std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + 3 * vertex_offsets[c]);
+				for (size_t i = 0; i < chunk.indices.size(); ++i) {
+					auto index = chunk.indices[i];
+					auto resolved = index >= 0 ? index : static_cast<int64_t>(vertex_offsets[c]) + (index - relative_index);
+					if (resolved < 0 || resolved >= static_cast<int64_t>(vertex_offsets.back())) {
+						std::lock_guard<std::mutex> lock(error_mutex);
+						error = std::make_exception_ptr(std::runtime_error("obj face index out of range"));
+						return;
+					}
+					indices[index_offsets[c] + i] = static_cast<uint32_t>(resolved);
+				}
+			});
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+	// parse a ply file (ascii or binary, with vertex x/y/z properties and a face index list)
+	// parameters:
+	//   data, size: the file contents
+	//   positions, indices: filled with the mesh buffers
+	//   threads: number of threads used to decode fixed-size binary vertex records
+	static void parsePly(const char *data, size_t size, std::vector<float> &positions,
+						 std::vector<uint32_t> &indices, unsigned threads = 0) {
+		auto header = parsePlyHeader(data, size);
+		auto cursor = data + header.body_offset;
+		auto end = data + size;
+		for (const auto &element : header.elements) {
+			if (element.name == "vertex") {
+				positions.resize(3 * element.count);
+				cursor = header.format == ply_format::ascii
+					? readAsciiVertices(cursor, end, element, positions)
+					: readBinaryVertices(cursor, end, element, header.format, positions, threadCount(threads, element.count * 12));
+			} else if (element.name == "face") {
+				cursor = header.format == ply_format::ascii
+					? readAsciiFaces(cursor, end, element, positions.size() / 3, indices)
+					: readBinaryFaces(cursor, end, element, header.format, positions.size() / 3, indices);
+			} else {
+				cursor = skipElement(cursor, end, element, header.format);
+			}
+		}
+	}
+
+private:
+
+	// offset marking obj face indices that are relative to the vertices before their chunk
+	static constexpr int64_t relative_index = -(int64_t(1) << 62);
+
+	// output of parsing one obj chunk (absolute face indices are 0-based, relative ones are stored as
+	// relative_index plus the 0-based index counted from the start of the chunk, which may be negative)
+	struct obj_chunk {
+		std::vector<float> positions;
+		std::vector<int64_t> indices;
+		std::exception_ptr error;
+	};
+
+	// ply body encoding
+	enum class ply_format { ascii, binary_little_endian, binary_big_endian };
+
+	// ply scalar property types
+	enum class ply_type { int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+	// a ply element property
+	struct ply_property {
+		std::string name;
+		ply_type type = ply_type::float32;
+		bool is_list = false;
+		ply_type count_type = ply_type::uint8;
+	};
+
+	// a ply element declaration
+	struct ply_element {
+		std::string name;
+		size_t count = 0;
+		std::vector<ply_property> properties;
+	};
+
+	// a parsed ply header
+	struct ply_header {
+		ply_format format = ply_format::ascii;
+		std::vector<ply_element> elements;
+		size_t body_offset = 0;
+	};
+
+	// limit the thread count so every thread has at least a megabyte of input
+	static unsigned threadCount(unsigned requested, size_t bytes) {
+		auto threads = requested > 0 ? requested : std::max(1u, std::thread::hardware_concurrency());
+		auto useful = static_cast<unsigned>(std::max<size_t>(1, bytes >> 20));
+		return std::min(threads, useful);
+	}
+
+	// skip spaces and tabs
+	static const char *skipBlanks(const char *p, const char *end) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+			++p;
+		}
+		return p;
+	}
+
+	// skip to the start of the next line
+	static const char *nextLine(const char *p, const char *end) {
+		while (p < end && *p != '\n') {
+			++p;
+		}
+		return p < end ? p + 1 : end;
+	}
+
+	// parse a number after optional blanks, advancing the cursor
+	template <typename T>
+	static bool readNumber(const char *&p, const char *end, T &value) {
+		p = skipBlanks(p, end);
+		// from_chars rejects a leading '+'
+		if (p < end && *p == '+') {
+			++p;
+		}
+		auto result = std::from_chars(p, end, value);
+		if (result.ec != std::errc()) {
+			return false;
+		}
+		p = result.ptr;
+		return true;
+	}
+
+	// parse the 'v' and 'f' records of an obj chunk
+	static void parseObjChunk(const char *p, const char *end, obj_chunk &chunk) {
+		std::vector<int64_t> polygon;
+		while (p < end) {
+			p = skipBlanks(p, end);
+			if (end - p > 1 && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+				// vertex position
+				p += 1;
+				for (int k = 0; k < 3; ++k) {
+					float value;
+					if (!readNumber(p, end, value)) {
+						throw std::runtime_error("malformed obj vertex");
+					}
+					chunk.positions.push_back(value);
+				}
+			} else if (end - p > 1 && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+				// face, read the vertex index of each 'v/vt/vn' corner
+				p += 1;
+				polygon.clear();
+				while (true) {
+					p = skipBlanks(p, end);
+					if (p == end || *p == '\n' || *p == '#') {
+						break;
+					}
+					// indices count from 1, or back from the latest vertex if negative, so 0 is never valid
+					int64_t index;
+					if (!readNumber(p, end, index) || index == 0 || (p < end && *p != '/' && !std::isspace(static_cast<unsigned char>(*p)))) {
+						throw std::runtime_error("malformed obj face");
+					}
+					auto local_vertices = static_cast<int64_t>(chunk.positions.size() / 3);
+					polygon.push_back(index > 0 ? index - 1 : relative_index + local_vertices + index);
+					while (p < end && !std::isspace(static_cast<unsigned char>(*p))) {
+						++p;
+					}
+				}
+				// fan triangulate
+				for (size_t k = 2; k < polygon.size(); ++k) {
+					chunk.indices.push_back(polygon[0]);
+					chunk.indices.push_back(polygon[k - 1]);
+					chunk.indices.push_back(polygon[k]);
+				}
+			}
+			p = nextLine(p, end);
+		}
+	}
+
+	// parse a ply type name
+	static ply_type plyType(const std::string &name) {
+		if (name == "char" || name == "int8") return ply_type::int8;
+		if (name == "uchar" || name == "uint8") return ply_type::uint8;
+		if (name == "short" || name == "int16") return ply_type::int16;
+		if (name == "ushort" || name == "uint16") return ply_type::uint16;
+		if (name == "int" || name == "int32") return ply_type::int32;
+		if (name == "uint" || name == "uint32") return ply_type::uint32;
+		if (name == "float" || name == "float32") return ply_type::float32;
+		if (name == "double" || name == "float64") return ply_type::float64;
+		throw std::runtime_error("unknown ply type " + name);
+	}
+
+	// return the size of a ply type in bytes
+	static size_t plyTypeSize(ply_type type) {
+		switch (type) {
+			case ply_type::int8: case ply_type::uint8: return 1;
+			case ply_type::int16: case ply_type::uint16: return 2;
+			case ply_type::int32: case ply_type::uint32: case ply_type::float32: return 4;
+			case ply_type::float64: return 8;
+		}
+		return 0;
+	}
+
+	// decode one binary ply value as a double
+	static double readBinary(const char *p, ply_type type, ply_format format) {
+		unsigned char bytes[8];
+		auto size = plyTypeSize(type);
+		std::memcpy(bytes, p, size);
+		// swap into host byte order
+		auto big_endian_data = format == ply_format::binary_big_endian;
+		if (big_endian_data != (std::endian::native == std::endian::big)) {
+			std::reverse(bytes, bytes + size);
+		}
+		switch (type) {
+			case ply_type::int8: { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+			case ply_type::uint8: { uint8_t v; std::memcpy(&v, bytes, 1); return v; }
+			case ply_type::int16: { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+			case ply_type::uint16: { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+			case ply_type::int32: { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+			case ply_type::uint32: { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+			case ply_type::float32: { float v; std::memcpy(&v, bytes, 4); return v; }
+			case ply_type::float64: { double v; std::memcpy(&v, bytes, 8); return v; }
+		}
+		return 0;
+	}
+
+	// parse the ply header up to and including 'end_header'
+	static ply_header parsePlyHeader(const char *data, size_t size) {
+		ply_header header;
+		auto p = data;
+		auto end = data + size;
+		if (size < 4 || std::strncmp(data, "ply", 3) != 0) {
+			throw std::runtime_error("not a ply file");
+		}
+		while (p < end) {
+			auto line_end = static_cast<const char *>(std::memchr(p, '\n', end - p));
+			if (line_end == nullptr) {
+				break;
+			}
+			// split the line into words
+			std::vector<std::string> words;
+			for (auto q = p; q < line_end;) {
+				q = skipBlanks(q, line_end);
+				auto word_start = q;
+				while (q < line_end && *q != ' ' && *q != '\t' && *q != '\r') {
+					++q;
+				}
+				if (q > word_start) {
+					words.emplace_back(word_start, q);
+				}
+			}
+			p = line_end + 1;
+			if (words.empty()) {
+				continue;
+			}
+			if (words[0] == "format" && words.size() > 1) {
+				if (words[1] == "ascii") header.format = ply_format::ascii;
+				else if (words[1] == "binary_little_endian") header.format = ply_format::binary_little_endian;
+				else if (words[1] == "binary_big_endian") header.format = ply_format::binary_big_endian;
+				else throw std::runtime_error("unknown ply format " + words[1]);
+			} else if (words[0] == "element" && words.size() > 2) {
+				header.elements.push_back(ply_element{ words[1], std::stoull(words[2]), {} });
+			} else if (words[0] == "property" && words.size() > 2 && !header.elements.empty()) {
+				ply_property property;
+				if (words[1] == "list" && words.size() > 4) {
+					property.is_list = true;
+					property.count_type = plyType(words[2]);
+					property.type = plyType(words[3]);
+					property.name = words[4];
+				} else {
+					property.type = plyType(words[1]);
+					property.name = words[2];
+				}
+				header.elements.back().properties.push_back(property);
+			} else if (words[0] == "end_header") {
+				header.body_offset = static_cast<size_t>(p - data);
+				return header;
+			}
+		}
+		throw std::runtime_error("ply header has no end_header");
+	}
+
+	// find the x, y and z property indices of a vertex element
+	static void vertexProperties(const ply_element &element, int (&xyz)[3]) {
+		const char *names[3] = { "x", "y", "z" };
+		for (int k = 0; k < 3; ++k) {
+			xyz[k] = -1;
+			for (size_t i = 0; i < element.properties.size(); ++i) {
+				if (element.properties[i].name == names[k]) {
+					xyz[k] = static_cast<int>(i);
+				}
+			}
+			if (xyz[k] < 0) {
+				throw std::runtime_error("ply vertex element has no position");
+			}
+		}
+	}
+
+	// append a fan-triangulated polygon, checking its indices
+	static void addPolygon(const std::vector<int64_t> &polygon, size_t vertex_count, std::vector<uint32_t> &indices) {
+		for (auto index : polygon) {
+			if (index < 0 || static_cast<size_t>(index) >= vertex_count) {
+				throw std::runtime_error("ply face index out of range");
+			}
+		}
+		for (size_t k = 2; k < polygon.size(); ++k) {
+			indices.push_back(static_cast<uint32_t>(polygon[0]));
+			indices.push_back(static_cast<uint32_t>(polygon[k - 1]));
+			indices.push_back(static_cast<uint32_t>(polygon[k]));
+		}
+	}
+
+	// read ascii vertex records
+	static const char *readAsciiVertices(const char *p, const char *end, const ply_element &element, std::vector<float> &positions) {
+		int xyz[3];
+		vertexProperties(element, xyz);
+		std::vector<double> values(element.properties.size());
+		for (size_t v = 0; v < element.count; ++v) {
+			for (auto &value : values) {
+				p = skipBlanks(p, end);
+				while (p < end && *p == '\n') {
+					p = skipBlanks(p + 1, end);
+				}
+				if (!readNumber(p, end, value)) {
+					throw std::runtime_error("malformed ply vertex");
+				}
+			}
+			for (int k = 0; k < 3; ++k) {
+				positions[3 * v + k] = static_cast<float>(values[xyz[k]]);
+			}
+		}
+		return nextLine(p, end);
+	}
+
+	// read ascii face records
+	static const char *readAsciiFaces(const char *p, const char *end, const ply_element &element,
+									  size_t vertex_count, std::vector<uint32_t> &indices) {
+		std::vector<int64_t> polygon;
+		for (size_t f = 0; f < element.count; ++f) {
+			for (const auto &property : element.properties) {
+				size_t count = 1;
+				if (property.is_list && !readNumber(p, end, count)) {
+					throw std::runtime_error("malformed ply face");
+				}
+				for (size_t k = 0; k < count; ++k) {
+					double value;
+					if (!readNumber(p, end, value)) {
+						throw std::runtime_error("malformed ply face");
+					}
+					if (property.is_list && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+						polygon.push_back(static_cast<int64_t>(value));
+					}
+				}
+			}
+			addPolygon(polygon, vertex_count, indices);
+			polygon.clear();
+			p = nextLine(p, end);
+		}
+		return p;
+	}
+
+	// read binary vertex records (fixed size, so decoded in parallel)
+	static const char *readBinaryVertices(const char *p, const char *end, const ply_element &element, ply_format format,
+										  std::vector<float> &positions, unsigned threads) {
+		int xyz[3];
+		vertexProperties(element, xyz);
+		// calculate the record stride and position offsets within a record
+		size_t stride = 0;
+		size_t offsets[3] = { 0, 0, 0 };
+		for (size_t i = 0; i < element.properties.size(); ++i) {
+			if (element.properties[i].is_list) {
+				throw std::runtime_error("ply vertex lists are not supported");
+			}
+			for (int k = 0; k < 3; ++k) {
+				if (xyz[k] == static_cast<int>(i)) offsets[k] = stride;
+			}
+			stride += plyTypeSize(element.properties[i].type);
+		}
+		if (static_cast<size_t>(end - p) < stride * element.count) {
+			throw std::runtime_error("truncated ply vertex data");
+		}
+		// decode a contiguous block of records per thread
+		std::vector<std::thread> workers;
+		for (unsigned c = 0; c < threads; ++c) {
+			workers.emplace_back([&, c] {
+				auto first = element.count * c / threads;
+				auto last = element.count * (c + 1) / threads;
+				for (auto v = first; v < last; ++v) {
+					auto record = p + v * stride;
+					for (int k = 0; k < 3; ++k) {
+						positions[3 * v + k] = static_cast<float>(readBinary(record + offsets[k], element.properties[xyz[k]].type, format));
+					}
+				}
+			});
+		}
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		return p + stride * element.count;
+	}
+
+	// read binary face records
+	static const char *readBinaryFaces(const char *p, const char *end, const ply_element &element, ply_format format,
+									   size_t vertex_count, std::vector<uint32_t> &indices) {
+		std::vector<int64_t> polygon;
+		indices.reserve(3 * element.count);
+		for (size_t f = 0; f < element.count; ++f) {
+			for (const auto &property : element.properties) {
+				size_t count = 1;
+				if (property.is_list) {
+					if (static_cast<size_t>(end - p) < plyTypeSize(property.count_type)) {
+						throw std::runtime_error("truncated ply face data");
+					}
+					count = static_cast<size_t>(readBinary(p, property.count_type, format));
+					p += plyTypeSize(property.count_type);
+				}
+				auto size = plyTypeSize(property.type);
+				if (static_cast<size_t>(end - p) < count * size) {
+					throw std::runtime_error("truncated ply face data");
+				}
+				if (property.is_list && (property.name == "vertex_indices" || property.name == "vertex_index")) {
+					for (size_t k = 0; k < count; ++k) {
+						polygon.push_back(static_cast<int64_t>(readBinary(p + k * size, property.type, format)));
+					}
+				}
+				p += count * size;
+			}
+			addPolygon(polygon, vertex_count, indices);
+			polygon.clear();
+		}
+		return p;
+	}
+
+	// skip the records of an element that is not needed
+	static const char *skipElement(const char *p, const char *end, const ply_element &element, ply_format format) {
+		for (size_t n = 0; n < element.count && p < end; ++n) {
+			if (format == ply_format::ascii) {
+				p = nextLine(p, end);
+				continue;
+			}
+			for (const auto &property : element.properties) {
+				size_t count = 1;
+				if (property.is_list) {
+					if (static_cast<size_t>(end - p) < plyTypeSize(property.count_type)) {
+						throw std::runtime_error("truncated ply data");
+					}
+					count = static_cast<size_t>(readBinary(p, property.count_type, format));
+					p += plyTypeSize(property.count_type);
+				}
+				if (static_cast<size_t>(end - p) < count * plyTypeSize(property.type)) {
+					throw std::runtime_error("truncated ply data");
+				}
+				p += count * plyTypeSize(property.type);
+			}
+		}
+		return p;
+	}
+
+};
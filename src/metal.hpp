@@ -1,5 +1,6 @@
 #pragma once
 #include "material.hpp"
+#include "texture.hpp"
 
 // a derived class representing a metal material
 class metal : public material {
@@ -10,6 +11,13 @@ public:
 	//   a: the albedo colour of the surface
 	//   f: the fuzziness of the material (reflection blur), values larger than 1 result in perfect reflection
 	metal(const colour &a, double f)
+		: _albedo(make_shared<solid_colour>(a)), _fuzz(f < 1 ? f : 1) { }
+
+	// constructor to initialise the metal material with a texture
+	// parameters:
+	//   a: the albedo texture of the surface
+	//   f: the fuzziness of the material (reflection blur), values larger than 1 result in perfect reflection
+	metal(shared_ptr<texture> a, double f)
 		: _albedo(a), _fuzz(f < 1 ? f : 1) { }
 
 	// scatter function for simulating interaction between a ray and a material
@@ -28,18 +36,39 @@ public:
 		// calculate a random scattering direction with a slight random deviation (fuzziness) for reflection blur
 		auto scatter_direction = reflected + _fuzz * randomUnitVector();
 		// create the scattered ray
-		scattered = ray(rec.point, scatter_direction);
-		// set attenuation to the material's albedo
-		attenuation = _albedo;
+		scattered = ray(rec.point, scatter_direction, r_in.time());
+		// set attenuation to the material's albedo at the hit point
+		attenuation = _albedo->value(rec.u, rec.v, rec.point);
 		// angle between the scattered ray direction and normal
 		auto angle = dot(scattered.direction(), rec.normal);
 		// returns true angle is positive (eg. above the surface)
 		return (angle > 0);
 	}
 
+	// return the albedo at the hit point
+	colour albedo(const hit_record &rec) const override {
+		return _albedo->value(rec.u, rec.v, rec.point);
+	}
+
+	// return the albedo texture
+	shared_ptr<texture> albedoTexture() const { return _albedo; }
+
+	// return the fuzziness
+	double fuzz() const { return _fuzz; }
+
+	// change the albedo to a constant colour (not while rendering)
+	// parameters:
+	//   a: the albedo colour of the surface
+	void setAlbedo(const colour &a) { _albedo = make_shared<solid_colour>(a); }
+
+	// change the fuzziness (not while rendering)
+	// parameters:
+	//   f: the fuzziness of the material, values larger than 1 result in perfect reflection
+	void setFuzz(double f) { _fuzz = f < 1 ? f : 1; }
+
 private:
 
-	colour _albedo;			// albedo colour of the metal
+	shared_ptr<texture> _albedo;	// albedo texture of the metal
 	double _fuzz;			// fuzziness factor for reflection blur
 
 };
@@ -0,0 +1,216 @@
+#pragma once
+#include "parallel.hpp"
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// work done by the threads of one numa node during a numaParallelFor
+struct numa_node_stats {
+	size_t items = 0;						// items completed by the node's threads
+	size_t stolen = 0;						// of those, items taken from another node's share
+	double seconds = 0;						// time until the node's last thread finished
+};
+
+// a class describing the numa nodes of the machine and the cpus belonging to each
+// (read from /sys/devices/system/node on linux, limited to the cpus this process may run on; elsewhere, or
+// if the topology cannot be read, the machine is treated as a single node)
+class numa_topology {
+public:
+
+	// constructor to detect the topology of the machine
+	numa_topology() {
+#ifdef __linux__
+		cpu_set_t allowed;
+		CPU_ZERO(&allowed);
+		auto restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+		// nodes are numbered but the numbers need not be contiguous
+		std::vector<std::pair<int, std::vector<int>>> found;
+		std::error_code error;
+		for (const auto &entry : std::filesystem::directory_iterator("/sys/devices/system/node", error)) {
+			auto name = entry.path().filename().string();
+			if (name.size() <= 4 || name.compare(0, 4, "node") != 0 || name.find_first_not_of("0123456789", 4) != std::string::npos) {
+				continue;
+			}
+			std::ifstream in(entry.path() / "cpulist");
+			std::string list;
+			std::getline(in, list);
+			std::vector<int> cpus;
+			for (auto cpu : parseCpuList(list)) {
+				if (!restricted || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))) {
+					cpus.push_back(cpu);
+				}
+			}
+			// memory-only nodes have no cpus to render on
+			if (!cpus.empty()) {
+				found.emplace_back(std::stoi(name.substr(4)), cpus);
+			}
+		}
+		std::sort(found.begin(), found.end());
+		for (auto &node : found) {
+			_nodes.push_back(node.second);
+		}
+#endif
+		// fall back to one node of every hardware thread
+		if (_nodes.empty()) {
+			_nodes.emplace_back();
+			for (unsigned cpu = 0; cpu < threadCount(0); ++cpu) {
+				_nodes.back().push_back(static_cast<int>(cpu));
+			}
+		}
+	}
+
+	// constructor to describe a given topology, eg. to emulate several nodes
+	// parameters:
+	//   nodes: the cpus of each node
+	explicit numa_topology(std::vector<std::vector<int>> nodes)
+		: _nodes(std::move(nodes)) { }
+
+	// return the number of nodes
+	size_t nodeCount() const { return _nodes.size(); }
+
+	// return the cpus of a node
+	const std::vector<int> &cpus(size_t node) const { return _nodes[node]; }
+
+	// return the total number of cpus
+	size_t cpuCount() const {
+		size_t count = 0;
+		for (const auto &node : _nodes) {
+			count += node.size();
+		}
+		return count;
+	}
+
+	// pin the calling thread to one cpu and record its node (see currentNode)
+	// parameters:
+	//   node: the node the cpu belongs to
+	//   cpu: the cpu
+	// returns:
+	//   true if the thread was pinned (the node is recorded either way)
+	static bool pinThread(size_t node, int cpu) {
+		currentNode() = node;
+#ifdef __linux__
+		if (cpu < 0 || cpu >= CPU_SETSIZE) {
+			return false;
+		}
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+		return false;
+#endif
+	}
+
+	// return the node of the calling thread, as recorded by pinThread (threads never pinned report node 0)
+	static size_t &currentNode() {
+		thread_local size_t node = 0;
+		return node;
+	}
+
+private:
+
+	std::vector<std::vector<int>> _nodes;	// cpus of each node
+
+	// parse a kernel cpu list such as '0-3,8-11'
+	static std::vector<int> parseCpuList(const std::string &list) {
+		std::vector<int> cpus;
+		std::istringstream in(list);
+		std::string range;
+		while (std::getline(in, range, ',')) {
+			int first = 0, last = 0;
+			char dash = 0;
+			std::istringstream parts(range);
+			if (!(parts >> first)) {
+				continue;
+			}
+			last = (parts >> dash >> last) ? last : first;
+			for (int cpu = first; cpu <= last; ++cpu) {
+				cpus.push_back(cpu);
+			}
+		}
+		return cpus;
+	}
+
+};
+
+// run a function over a range of items on threads pinned to cpus across numa nodes
+// (items are split into one contiguous share per node in proportion to its threads; a node's threads take items
+// from their own share first and only then from other nodes' shares, so neighbouring items stay on one node)
+// parameters:
+//   count: the number of items
+//   threads: the number of threads (0 uses one per cpu), dealt out across the nodes in turn
+//   topology: the nodes and their cpus
+//   function: called with each item index, from a pinned thread
+//   stats: if not null, receives the work done by each node (added to any existing values)
+template <typename Function>
+void numaParallelFor(size_t count, unsigned threads, const numa_topology &topology, const Function &function,
+					 std::vector<numa_node_stats> *stats = nullptr) {
+	auto nodes = topology.nodeCount();
+	auto thread_total = threads > 0 ? threads : static_cast<unsigned>(topology.cpuCount());
+	// deal threads out across the nodes, then each node's threads across its cpus
+	std::vector<std::pair<size_t, int>> placements;
+	std::vector<size_t> node_threads(nodes, 0);
+	for (unsigned t = 0; t < thread_total; ++t) {
+		auto node = t % nodes;
+		const auto &cpus = topology.cpus(node);
+		placements.emplace_back(node, cpus[node_threads[node]++ % cpus.size()]);
+	}
+	// split the items into node shares, each on its own cache line
+	struct alignas(64) share {
+		std::atomic<size_t> next{ 0 };
+		size_t end = 0;
+	};
+	std::vector<share> shares(nodes);
+	size_t assigned = 0, first = 0;
+	for (size_t node = 0; node < nodes; ++node) {
+		assigned += node_threads[node];
+		shares[node].next = first;
+		shares[node].end = first = count * assigned / thread_total;
+	}
+	// per-node results
+	std::vector<numa_node_stats> results(nodes);
+	std::mutex results_mutex;
+	auto start = std::chrono::steady_clock::now();
+	auto worker = [&](size_t node, int cpu) {
+		numa_topology::pinThread(node, cpu);
+		size_t items = 0, stolen = 0;
+		// own share first, then the other nodes in turn
+		for (size_t n = 0; n < nodes; ++n) {
+			auto &from = shares[(node + n) % nodes];
+			for (auto i = from.next++; i < from.end; i = from.next++) {
+				function(i);
+				++items;
+				stolen += n > 0 ? 1 : 0;
+			}
+		}
+		auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::lock_guard<std::mutex> lock(results_mutex);
+		results[node].items += items;
+		results[node].stolen += stolen;
+		results[node].seconds = fmax(results[node].seconds, elapsed);
+	};
+	// the calling thread only waits, so its own affinity is left alone
+	std::vector<std::thread> workers;
+	for (const auto &placement : placements) {
+		workers.emplace_back(worker, placement.first, placement.second);
+	}
+	for (auto &w : workers) {
+		w.join();
+	}
+	if (stats != nullptr) {
+		stats->resize(std::max(stats->size(), nodes));
+		for (size_t node = 0; node < nodes; ++node) {
+			(*stats)[node].items += results[node].items;
+			(*stats)[node].stolen += results[node].stolen;
+			(*stats)[node].seconds += results[node].seconds;
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "hittable.hpp"
+#include "numa.hpp"
+#include <functional>
+
+// a class representing a scene replicated once per numa node, so render threads read geometry, acceleration
+// structures and materials from their own node's memory
+// (each replica is built by a thread pinned to its node, so under the default first-touch policy its memory is
+// allocated there; the random number generator is reseeded for each build, so a builder that draws its layout
+// from randomDouble produces identical replicas; rays are traced against the replica of the calling thread's node)
+class numa_scene : public hittable {
+public:
+
+	// constructor to build a replica of the scene on each node
+	// parameters:
+	//   topology: the nodes to replicate across
+	//   build: builds one copy of the scene, called once on each node
+	//   seed: random seed shared by every build
+	numa_scene(const numa_topology &topology, const std::function<shared_ptr<hittable>()> &build,
+			   unsigned seed = std::random_device{}()) {
+		_replicas.resize(topology.nodeCount());
+		// build the replicas concurrently, one thread on the first cpu of each node
+		std::vector<std::thread> builders;
+		for (size_t node = 0; node < topology.nodeCount(); ++node) {
+			builders.emplace_back([&, node] {
+				numa_topology::pinThread(node, topology.cpus(node).front());
+				randomGenerator().seed(seed);
+				_replicas[node] = build();
+			});
+		}
+		for (auto &builder : builders) {
+			builder.join();
+		}
+	}
+
+	// return the number of replicas
+	size_t replicaCount() const { return _replicas.size(); }
+
+	// return the replica of a node
+	const hittable &replica(size_t node) const { return *_replicas[node]; }
+
+	// check for intersection with the replica of the calling thread's node
+	// parameters:
+	//   r: the ray
+	//	 ray_t: an interval representing the range of intersection values
+	//   rec: the record containing intersection information
+	// returns:
+	//   true if an intersection matched else false
+	bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+		return _replicas[numa_topology::currentNode() % _replicas.size()]->hit(r, ray_t, rec);
+	}
+
+	// return the box enclosing the scene (the same for every replica)
+	aabb boundingBox() const override { return _replicas.front()->boundingBox(); }
+
+private:
+
+	std::vector<shared_ptr<hittable>> _replicas;	// one copy of the scene per node
+
+};
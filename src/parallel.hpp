@@ -0,0 +1,38 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// resolve a requested thread count
+// parameters:
+//   requested: the requested number of threads (0 uses every hardware thread)
+// returns:
+//   the number of threads to use
+inline unsigned threadCount(unsigned requested) {
+	return requested > 0 ? requested : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// run a function over a range of items across several threads, handing out items one at a time
+// parameters:
+//   count: the number of items
+//   threads: the number of threads (0 uses every hardware thread)
+//   function: called with each item index, from any thread
+template <typename Function>
+void parallelFor(size_t count, unsigned threads, const Function &function) {
+	std::atomic<size_t> next{ 0 };
+	auto worker = [&] {
+		for (auto i = next++; i < count; i = next++) {
+			function(i);
+		}
+	};
+	// the calling thread does a share of the work
+	std::vector<std::thread> workers;
+	for (unsigned t = 1; t < std::min<size_t>(threadCount(threads), count); ++t) {
+		workers.emplace_back(worker);
+	}
+	worker();
+	for (auto &w : workers) {
+		w.join();
+	}
+}
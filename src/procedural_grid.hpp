@@ -0,0 +1,215 @@
+#pragma once
+#include "hittable_list.hpp"
+#include "lru_cache.hpp"
+#include <array>
+#include <functional>
+
+// a class representing a procedural field of objects over a uniform grid, generated cell by cell as rays reach them
+// (rays walk the grid cell by cell with a 3d-dda; the first ray to reach a cell generates its objects with the
+// random number generator seeded from the grid seed and the cell, so a cell always holds the same objects however
+// often it is evicted and regenerated; generated cells are kept in a bounded least recently used cache, so memory
+// stays constant however many cells the grid has)
+class procedural_grid : public hittable {
+public:
+
+	// fills a cell with objects, drawing any random values from randomDouble
+	// parameters:
+	//   corner: the lower corner of the cell
+	//   cell: receives the cell's objects, which must lie within the cell grown by the margin on every side
+	using cell_generator = std::function<void(const point3 &corner, hittable_list &cell)>;
+
+	// constructor to initialise the grid
+	// parameters:
+	//   origin: the lower corner of the grid
+	//   cell_size: the size of each cell
+	//   counts: the number of cells along each axis
+	//   margin: how far objects may reach outside their cell (at most the cell size)
+	//   generate: fills a cell with objects
+	//   seed: the seed of the field
+	//   cache_cells: the most cells held at once
+	procedural_grid(const point3 &origin, const vec3 &cell_size, std::array<int64_t, 3> counts, double margin,
+					cell_generator generate, uint64_t seed, size_t cache_cells = size_t(1) << 16)
+		: _origin(origin), _cell_size(cell_size), _counts(counts), _generate(std::move(generate)), _seed(seed),
+		  _cells(cache_cells, shard_count) {
+		auto far = point3(origin[0] + cell_size[0] * counts[0], origin[1] + cell_size[1] * counts[1], origin[2] + cell_size[2] * counts[2]);
+		_bbox = aabb(interval(origin[0] - margin, far[0] + margin), interval(origin[1] - margin, far[1] + margin),
+					 interval(origin[2] - margin, far[2] + margin));
+	}
+
+	// check for intersection, walking the grid cell by cell from where the ray enters it
+	// parameters:
+	//   r: the ray
+	//	 ray_t: an interval representing the range of intersection values
+	//   rec: the record containing intersection information
+	// returns:
+	//   true if an intersection matched else false
+	bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+		// clip the ray to the grid (grown by the margin)
+		auto t_enter = ray_t.min, t_leave = ray_t.max;
+		for (int axis = 0; axis < 3; ++axis) {
+			auto inverse = 1 / r.direction()[axis];
+			auto t0 = (_bbox.axis(axis).min - r.origin()[axis]) * inverse;
+			auto t1 = (_bbox.axis(axis).max - r.origin()[axis]) * inverse;
+			if (inverse < 0) {
+				std::swap(t0, t1);
+			}
+			t_enter = fmax(t_enter, t0);
+			t_leave = fmin(t_leave, t1);
+			if (t_leave <= t_enter) {
+				return false;
+			}
+		}
+		// set up the walk from the entry cell (the cells just outside the grid are walked too, as objects in the
+		// edge cells reach into them)
+		std::array<int64_t, 3> cell, step;
+		double t_next[3], t_delta[3];
+		for (int axis = 0; axis < 3; ++axis) {
+			auto d = r.direction()[axis];
+			auto p = r.origin()[axis] + t_enter * d;
+			cell[axis] = std::clamp<int64_t>(static_cast<int64_t>(floor((p - _origin[axis]) / _cell_size[axis])), -1, _counts[axis]);
+			if (d > 0) {
+				step[axis] = 1;
+				t_next[axis] = (_origin[axis] + (cell[axis] + 1) * _cell_size[axis] - r.origin()[axis]) / d;
+				t_delta[axis] = _cell_size[axis] / d;
+			} else if (d < 0) {
+				step[axis] = -1;
+				t_next[axis] = (_origin[axis] + cell[axis] * _cell_size[axis] - r.origin()[axis]) / d;
+				t_delta[axis] = -_cell_size[axis] / d;
+			} else {
+				step[axis] = 0;
+				t_next[axis] = t_delta[axis] = infinity;
+			}
+		}
+		// objects reach at most one cell outside their own, so the first cell tests its 3x3x3 neighbourhood and
+		// each step tests only the 3x3 slab of neighbours newly in reach
+		auto closest = ray_t.max;
+		auto hit_anything = testCells(r, interval(ray_t.min, closest), rec, cell, -1, 0, closest);
+		while (true) {
+			auto axis = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+			// every object reaching the ray before it leaves this cell has been tested
+			auto t_exit = t_next[axis];
+			if ((hit_anything && closest <= t_exit) || t_exit > t_leave) {
+				break;
+			}
+			cell[axis] += step[axis];
+			if (cell[axis] < -1 || cell[axis] > _counts[axis]) {
+				break;
+			}
+			t_next[axis] += t_delta[axis];
+			hit_anything |= testCells(r, interval(ray_t.min, closest), rec, cell, axis, step[axis], closest);
+		}
+		return hit_anything;
+	}
+
+	// return the box enclosing every cell, grown by the margin
+	aabb boundingBox() const override { return _bbox; }
+
+	// generate every cell up front, as an eagerly built scene with the same objects
+	// returns:
+	//   the objects of every cell
+	hittable_list eager() const {
+		hittable_list all;
+		for (int64_t z = 0; z < _counts[2]; ++z) {
+			for (int64_t y = 0; y < _counts[1]; ++y) {
+				for (int64_t x = 0; x < _counts[0]; ++x) {
+					auto cell = generateCell({ x, y, z });
+					for (const auto &object : cell->objects) {
+						all.add(object);
+					}
+				}
+			}
+		}
+		return all;
+	}
+
+	// return the number of cells currently cached
+	size_t cachedCells() const { return _cells.count(); }
+
+	// return the number of cell lookups served from the cache
+	size_t cacheHits() const { return _cells.hits(); }
+
+	// return the number of cell lookups that generated the cell
+	size_t cacheMisses() const { return _cells.misses(); }
+
+private:
+
+	using cell_objects = shared_ptr<const hittable_list>;
+
+	static constexpr size_t shard_count = 16;	// number of cache shards
+
+	point3 _origin;							// lower corner of the grid
+	vec3 _cell_size;						// size of each cell
+	std::array<int64_t, 3> _counts;			// cells along each axis
+	cell_generator _generate;				// fills a cell
+	uint64_t _seed;							// seed of the field
+	aabb _bbox;								// box enclosing every cell, grown by the margin
+	mutable lru_cache<cell_objects> _cells;	// cache of generated cells, in shards so threads rarely wait on each other
+
+	// test the objects of a cell's neighbours for intersection, keeping the closest hit
+	// parameters:
+	//   r, ray_t, rec: as for hit (ray_t.max is the closest hit so far)
+	//   cell: the cell
+	//   axis: the axis of the last step, or -1 to test the whole neighbourhood
+	//   step: the direction of the last step
+	//   closest: updated with the distance of the closest hit
+	// returns:
+	//   true if an object was hit
+	bool testCells(const ray &r, interval ray_t, hit_record &rec, const std::array<int64_t, 3> &cell, int axis, int64_t step,
+				   double &closest) const {
+		auto hit_anything = false;
+		std::array<int64_t, 3> lower, upper;
+		for (int a = 0; a < 3; ++a) {
+			lower[a] = std::max<int64_t>(cell[a] - 1, 0);
+			upper[a] = std::min<int64_t>(cell[a] + 1, _counts[a] - 1);
+		}
+		// after a step, only the slab on the far side of the new cell is newly in reach
+		if (axis >= 0) {
+			lower[axis] = upper[axis] = cell[axis] + step;
+			if (lower[axis] < 0 || lower[axis] >= _counts[axis]) {
+				return false;
+			}
+		}
+		hit_record temp_rec;
+		for (auto z = lower[2]; z <= upper[2]; ++z) {
+			for (auto y = lower[1]; y <= upper[1]; ++y) {
+				for (auto x = lower[0]; x <= upper[0]; ++x) {
+					auto objects = cachedCell({ x, y, z });
+					for (const auto &object : objects->objects) {
+						if (object->hit(r, interval(ray_t.min, closest), temp_rec)) {
+							hit_anything = true;
+							closest = temp_rec.distance;
+							rec = temp_rec;
+						}
+					}
+				}
+			}
+		}
+		return hit_anything;
+	}
+
+	// return a cell's objects from the cache, generating them on a miss
+	cell_objects cachedCell(const std::array<int64_t, 3> &cell) const {
+		return _cells.get(cellKey(cell), [&] { return generateCell(cell); });
+	}
+
+	// generate a cell's objects with the random number generator seeded for the cell
+	cell_objects generateCell(const std::array<int64_t, 3> &cell) const {
+		auto corner = point3(_origin[0] + cell[0] * _cell_size[0], _origin[1] + cell[1] * _cell_size[1],
+							 _origin[2] + cell[2] * _cell_size[2]);
+		auto key = cellKey(cell);
+		// keep the calling thread's random sequence as it was
+		auto &generator = randomGenerator();
+		auto saved = generator;
+		generator.seed(static_cast<std::mt19937::result_type>(mixBits(_seed ^ mixBits(key))));
+		auto objects = make_shared<hittable_list>();
+		_generate(corner, *objects);
+		generator = saved;
+		return objects;
+	}
+
+	// return the index of a cell within the grid
+	uint64_t cellKey(const std::array<int64_t, 3> &cell) const {
+		return static_cast<uint64_t>(cell[0] + _counts[0] * (cell[1] + _counts[1] * cell[2]));
+	}
+
+};
@@ -13,7 +13,15 @@ public:
 	//   origin: the origin point of the ray
 	//   direction: the direction vector of the ray
 	ray(const point3& origin, const vec3& direction)
-		: _origin(origin), _direction(direction) { }
+		: _origin(origin), _direction(direction), _time(0) { }
+
+	// constructor to initialise the ray with an origin, direction and time
+	// parameters:
+	//   origin: the origin point of the ray
+	//   direction: the direction vector of the ray
+	//   time: the moment in time the ray was cast (within the camera shutter interval)
+	ray(const point3& origin, const vec3& direction, double time)
+		: _origin(origin), _direction(direction), _time(time) { }
 
 	// return the origin point of the ray
 	point3 origin() const { return _origin; }
@@ -21,6 +29,9 @@ public:
 	// return the direction vector of the ray
 	vec3 direction() const { return _direction; }
 
+	// return the time the ray was cast
+	double time() const { return _time; }
+
 	// compute a point along the ray at a given value
 	// parameters:
 	//   t: the value along the ray
@@ -32,5 +43,6 @@ private:
 
 	point3 _origin;					// origin point of the ray
 	vec3 _direction;				// direction vector of the ray
+	double _time = 0;				// time the ray was cast
 
 };
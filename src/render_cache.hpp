@@ -0,0 +1,118 @@
+#pragma once
+#include "colour.hpp"
+#include "material.hpp"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// a class representing a rendered image together with the materials each pixel's paths touched, so the image can be
+// brought up to date after a material edit by re-rendering only the pixels that saw the material
+// (materials are identified by address, so edits must change a material in place, eg. lambertian::setAlbedo,
+// rather than replace it; exposure is applied when writing, so exposure edits need no re-render at all)
+class render_cache {
+public:
+
+	int width = 0;							// image width in pixels
+	int height = 0;							// image height in pixels
+	std::vector<colour> pixels;				// mean pixel colour (linear, before exposure)
+	std::vector<uint32_t> samples;			// samples averaged into each pixel
+
+	// constructor to allocate an empty cache
+	// parameters:
+	//   w: image width
+	//   h: image height
+	render_cache(int w, int h)
+		: width(w), height(h), pixels(static_cast<size_t>(w) * h), samples(pixels.size(), 0),
+		  _touch_offsets(pixels.size() + 1, 0) { }
+
+	// return the pixels whose paths touched any of a set of materials
+	// parameters:
+	//   changed: the edited materials
+	std::vector<size_t> affectedPixels(const std::vector<const material *> &changed) const {
+		// mark the identifiers of the changed materials
+		std::vector<bool> marked(_materials.size(), false);
+		for (auto m : changed) {
+			auto found = _material_ids.find(m);
+			if (found != _material_ids.end()) {
+				marked[found->second] = true;
+			}
+		}
+		std::vector<size_t> affected;
+		for (size_t p = 0; p < pixels.size(); ++p) {
+			for (auto t = _touch_offsets[p]; t < _touch_offsets[p + 1]; ++t) {
+				if (marked[_touch_ids[t]]) {
+					affected.push_back(p);
+					break;
+				}
+			}
+		}
+		return affected;
+	}
+
+	// replace the materials touched by some pixels
+	// parameters:
+	//   updated: the pixels
+	//   touched: the materials touched by each updated pixel's paths (in any order, with repeats)
+	void setTouches(const std::vector<size_t> &updated, std::vector<std::vector<const material *>> &touched) {
+		// rebuild the compressed lists, taking updated pixels from the new records
+		std::vector<int64_t> slot(pixels.size(), -1);
+		for (size_t u = 0; u < updated.size(); ++u) {
+			slot[updated[u]] = static_cast<int64_t>(u);
+		}
+		std::vector<uint32_t> offsets(pixels.size() + 1, 0), ids;
+		ids.reserve(_touch_ids.size());
+		for (size_t p = 0; p < pixels.size(); ++p) {
+			if (slot[p] < 0) {
+				ids.insert(ids.end(), _touch_ids.begin() + _touch_offsets[p], _touch_ids.begin() + _touch_offsets[p + 1]);
+			} else {
+				auto &list = touched[slot[p]];
+				std::sort(list.begin(), list.end());
+				list.erase(std::unique(list.begin(), list.end()), list.end());
+				for (auto m : list) {
+					ids.push_back(materialId(m));
+				}
+				// free each record once it is compressed
+				std::vector<const material *>().swap(list);
+			}
+			offsets[p + 1] = static_cast<uint32_t>(ids.size());
+		}
+		_touch_offsets.swap(offsets);
+		_touch_ids.swap(ids);
+	}
+
+	// write the image with an exposure applied
+	// parameters:
+	//   out: the output stream receiving the image
+	//   exposure: scale applied to the linear colour
+	void write(std::ostream &out, double exposure = 1.0) const {
+		// image header (.ppm format)
+		out << "P3\n"
+			<< width << " " << height << "\n255\n";
+		for (const auto &pixel_colour : pixels) {
+			writeColour(out, exposure * pixel_colour, 1);
+		}
+	}
+
+	// return the number of bytes held by the touch records
+	size_t touchBytes() const {
+		return _touch_offsets.size() * sizeof(uint32_t) + _touch_ids.size() * sizeof(uint32_t) +
+			   _materials.size() * sizeof(const material *);
+	}
+
+private:
+
+	std::vector<uint32_t> _touch_offsets;	// material identifiers of pixel p are _touch_ids[_touch_offsets[p], _touch_offsets[p + 1])
+	std::vector<uint32_t> _touch_ids;		// material identifiers touched by each pixel, in pixel order
+	std::vector<const material *> _materials;	// material of each identifier
+	std::unordered_map<const material *, uint32_t> _material_ids;	// identifier of each material
+
+	// return the identifier of a material, assigning the next one on first sight
+	uint32_t materialId(const material *m) {
+		auto [found, added] = _material_ids.emplace(m, static_cast<uint32_t>(_materials.size()));
+		if (added) {
+			_materials.push_back(m);
+		}
+		return found->second;
+	}
+
+};
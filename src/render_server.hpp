@@ -0,0 +1,406 @@
+#pragma once
+#include "camera.hpp"
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <queue>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+// a class representing a long-running render server that keeps one scene resident and renders jobs received over
+// a unix domain socket
+// (each message is a 4-byte big-endian length followed by that many bytes of 'key=value' lines; every request
+// carries a 'command' key and receives one reply with a 'status' key of 'ok' or 'error'; each connection is
+// served on its own thread, so a slow or idle client never holds up the others)
+//
+// commands:
+//   submit    queue a render: output (required), priority, width, aspect, spp, depth, fov, from, at, up,
+//             defocus, focus, shutter_open, shutter_close, denoise (vectors as 'x,y,z'); replies with 'job',
+//             or with an error if the queue is full
+//   status    report the 'state' of a job: queued, running, done, cancelled or failed (only the most recent
+//             finished jobs are remembered)
+//   cancel    cancel a queued or running job
+//   shutdown  cancel every job and stop the server
+class render_server {
+public:
+
+	// constructor to initialise the server
+	// parameters:
+	//   world: the resident scene, shared by every job
+	//   defaults: camera settings used for any parameter a job does not specify
+	//   max_queued: the most jobs waiting to render, further submissions are refused
+	//   max_connections: the most clients connected at once, further connections are refused
+	render_server(shared_ptr<hittable> world, const camera &defaults, size_t max_queued = 64, size_t max_connections = 32)
+		: _world(world), _defaults(defaults), _max_queued(max_queued), _max_connections(max_connections) { }
+
+	// listen on a socket and serve requests until a shutdown command arrives
+	// parameters:
+	//   socket_path: path of the unix domain socket (replaced if it exists)
+	void run(const std::string &socket_path) {
+		// a client closing its connection early must not terminate the server
+		std::signal(SIGPIPE, SIG_IGN);
+		auto address = socketAddress(socket_path);
+		auto listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		unlink(socket_path.c_str());
+		if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+			throw std::runtime_error("unable to listen on " + socket_path);
+		}
+		std::clog << "Serving on " << socket_path << "\n";
+
+		// render jobs on a separate thread so requests are answered while rendering
+		_listener = listener;
+		std::thread worker([this] { renderJobs(); });
+		while (!_stopping) {
+			auto connection = accept(listener, nullptr, nullptr);
+			if (connection < 0) {
+				// an interrupted call or a client that gave up is retried at once, but other errors (eg. running out
+				// of descriptors) would fail again immediately, so back off rather than spin
+				if (!_stopping && errno != EINTR && errno != ECONNABORTED) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(accept_retry_milliseconds));
+				}
+				continue;
+			}
+			auto accepted = false;
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				if (!_stopping && _connections.size() < _max_connections) {
+					_connections.insert(connection);
+					accepted = true;
+				}
+			}
+			if (!accepted) {
+				writeFrame(connection, "status=error\nmessage=too many connections\n");
+				close(connection);
+				continue;
+			}
+			// a client idle for longer than the timeout is disconnected, freeing its place
+			timeval timeout{ idle_timeout_seconds, 0 };
+			setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+			std::thread([this, connection] { serve(connection); }).detach();
+		}
+
+		// end the remaining clients' requests (replies still being written, eg. to the shutdown command, are sent),
+		// wait for their threads, then stop the worker and clean up
+		{
+			std::unique_lock<std::mutex> lock(_mutex);
+			for (auto connection : _connections) {
+				::shutdown(connection, SHUT_RD);
+			}
+			_disconnected.wait(lock, [this] { return _connections.empty(); });
+		}
+		worker.join();
+		close(listener);
+		unlink(socket_path.c_str());
+	}
+
+	// send one request to a server and wait for its reply
+	// parameters:
+	//   socket_path: path of the server socket
+	//   request: the 'key=value' lines of the request
+	// returns:
+	//   the reply
+	static std::string request(const std::string &socket_path, const std::string &request) {
+		auto address = socketAddress(socket_path);
+		auto connection = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (connection < 0 || connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+			throw std::runtime_error("unable to connect to " + socket_path);
+		}
+		std::string reply;
+		auto ok = writeFrame(connection, request) && readFrame(connection, reply);
+		close(connection);
+		if (!ok) {
+			throw std::runtime_error("no reply from " + socket_path);
+		}
+		return reply;
+	}
+
+private:
+
+	// a queued or finished render job
+	struct job {
+		int id;									// job identifier
+		int priority;							// higher priorities render first
+		camera settings;						// camera for this job
+		std::string output;						// output image path
+		std::string state = "queued";			// queued, running, done, cancelled or failed
+		std::atomic<bool> cancelled{ false };	// set to stop the job
+	};
+
+	// orders the queue by descending priority, then by submission
+	struct job_order {
+		bool operator()(const shared_ptr<job> &a, const shared_ptr<job> &b) const {
+			return a->priority != b->priority ? a->priority < b->priority : a->id > b->id;
+		}
+	};
+
+	using message = std::map<std::string, std::string>;
+
+	static constexpr int idle_timeout_seconds = 60;		// seconds a client may wait between requests
+	static constexpr size_t max_finished = 1024;		// finished jobs remembered for status requests
+	static constexpr int accept_retry_milliseconds = 100;	// wait before accepting again after a failure
+
+	shared_ptr<hittable> _world;			// resident scene
+	camera _defaults;						// default camera settings
+	size_t _max_queued;						// most jobs waiting to render
+	size_t _max_connections;				// most clients connected at once
+	std::priority_queue<shared_ptr<job>, std::vector<shared_ptr<job>>, job_order> _queue;	// jobs waiting to render
+	size_t _queued = 0;						// jobs in the queue that are not cancelled
+	std::map<int, shared_ptr<job>> _jobs;	// queued, running and recently finished jobs by identifier
+	std::deque<int> _finished;				// finished jobs, oldest first
+	int _next_id = 1;						// identifier of the next job
+	std::atomic<bool> _stopping{ false };	// set by the shutdown command
+	int _listener = -1;						// listening socket
+	std::set<int> _connections;				// connected clients
+	std::mutex _mutex;						// guards the queue, job table, job states and connections
+	std::condition_variable _wake;			// signalled when a job is queued or the server stops
+	std::condition_variable _disconnected;	// signalled when a client disconnects
+
+	// answer every request on a connection until the client closes it, goes idle or the server stops
+	// parameters:
+	//   connection: the connected socket
+	void serve(int connection) {
+		std::string request;
+		while (readFrame(connection, request)) {
+			if (!writeFrame(connection, handle(parseMessage(request)))) {
+				break;
+			}
+		}
+		// close under the lock so the descriptor is not reused while run() may still shut it down
+		std::lock_guard<std::mutex> lock(_mutex);
+		close(connection);
+		_connections.erase(connection);
+		_disconnected.notify_all();
+	}
+
+	// mark a job finished, forgetting the oldest finished jobs beyond max_finished (call with the lock held)
+	// parameters:
+	//   finished: the job
+	//   state: its final state
+	void finish(const shared_ptr<job> &finished, const std::string &state) {
+		finished->state = state;
+		_finished.push_back(finished->id);
+		while (_finished.size() > max_finished) {
+			_jobs.erase(_finished.front());
+			_finished.pop_front();
+		}
+	}
+
+	// render queued jobs one at a time (each render uses every render thread) until the server stops
+	void renderJobs() {
+		while (true) {
+			shared_ptr<job> next;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_wake.wait(lock, [this] { return _stopping || !_queue.empty(); });
+				if (_stopping) {
+					return;
+				}
+				next = _queue.top();
+				_queue.pop();
+				// skip jobs cancelled while queued
+				if (next->cancelled) {
+					continue;
+				}
+				--_queued;
+				next->state = "running";
+			}
+			// render to a temporary file, renamed once complete so readers never see a partial image
+			std::clog << "Job " << next->id << ": rendering " << next->output << "\n";
+			auto temporary = next->output + ".partial";
+			bool completed = false;
+			{
+				std::ofstream out(temporary);
+				completed = out && next->settings.render(*_world, out, &next->cancelled) && out.flush();
+			}
+			auto renamed = completed && std::rename(temporary.c_str(), next->output.c_str()) == 0;
+			if (!renamed) {
+				std::remove(temporary.c_str());
+			}
+			std::lock_guard<std::mutex> lock(_mutex);
+			finish(next, renamed ? "done" : (next->cancelled ? "cancelled" : "failed"));
+		}
+	}
+
+	// handle one request
+	// parameters:
+	//   request: the parsed request
+	// returns:
+	//   the reply
+	std::string handle(const message &request) {
+		auto command = value(request, "command", "");
+		try {
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (command == "submit") {
+				auto submitted = std::make_shared<job>();
+				submitted->priority = std::stoi(value(request, "priority", "0"));
+				submitted->output = value(request, "output", "");
+				submitted->settings = jobCamera(request);
+				if (submitted->output.empty()) {
+					return "status=error\nmessage=missing output\n";
+				}
+				if (_queued >= _max_queued) {
+					return "status=error\nmessage=queue full\n";
+				}
+				// number only accepted jobs, so refused submissions leave no gaps
+				submitted->id = _next_id++;
+				_jobs[submitted->id] = submitted;
+				_queue.push(submitted);
+				++_queued;
+				_wake.notify_one();
+				return "status=ok\njob=" + std::to_string(submitted->id) + "\n";
+			}
+			if (command == "status" || command == "cancel") {
+				auto found = _jobs.find(std::stoi(value(request, "job", "0")));
+				if (found == _jobs.end()) {
+					return "status=error\nmessage=unknown job\n";
+				}
+				auto &existing = found->second;
+				if (command == "cancel" && (existing->state == "queued" || existing->state == "running")) {
+					existing->cancelled = true;
+					// a queued job is finished at once, a running one when its render next polls the flag
+					if (existing->state == "queued") {
+						--_queued;
+						finish(existing, "cancelled");
+					}
+				}
+				return "status=ok\nstate=" + existing->state + "\n";
+			}
+			if (command == "shutdown") {
+				for (auto &entry : _jobs) {
+					entry.second->cancelled = true;
+				}
+				_stopping = true;
+				_wake.notify_one();
+				// wake run() from accept
+				::shutdown(_listener, SHUT_RDWR);
+				return "status=ok\n";
+			}
+			return "status=error\nmessage=unknown command\n";
+		} catch (const std::exception &error) {
+			// malformed numbers
+			return std::string("status=error\nmessage=") + error.what() + "\n";
+		}
+	}
+
+	// build the camera for a job from the defaults and the request parameters
+	camera jobCamera(const message &request) const {
+		auto settings = _defaults;
+		settings.image_width = std::stoi(value(request, "width", std::to_string(settings.image_width)));
+		settings.aspect_ratio = std::stod(value(request, "aspect", std::to_string(settings.aspect_ratio)));
+		settings.samples_per_pixel = std::stoi(value(request, "spp", std::to_string(settings.samples_per_pixel)));
+		settings.ray_depth = std::stoi(value(request, "depth", std::to_string(settings.ray_depth)));
+		settings.v_fov = std::stod(value(request, "fov", std::to_string(settings.v_fov)));
+		settings.defocus_angle = std::stod(value(request, "defocus", std::to_string(settings.defocus_angle)));
+		settings.focus_distance = std::stod(value(request, "focus", std::to_string(settings.focus_distance)));
+		settings.shutter_open = std::stod(value(request, "shutter_open", std::to_string(settings.shutter_open)));
+		settings.shutter_close = std::stod(value(request, "shutter_close", std::to_string(settings.shutter_close)));
+		settings.denoise = value(request, "denoise", settings.denoise ? "1" : "0") == "1";
+		settings.look_from = vectorValue(request, "from", settings.look_from);
+		settings.look_at = vectorValue(request, "at", settings.look_at);
+		settings.v_up = vectorValue(request, "up", settings.v_up);
+		// jobs never write feature buffers over each other
+		settings.feature_prefix.clear();
+		if (settings.image_width < 1 || settings.aspect_ratio <= 0 || settings.samples_per_pixel < 1) {
+			throw std::invalid_argument("invalid image settings");
+		}
+		return settings;
+	}
+
+	// return a message value, or a fallback if the key is absent
+	static std::string value(const message &m, const std::string &key, const std::string &fallback) {
+		auto found = m.find(key);
+		return found == m.end() ? fallback : found->second;
+	}
+
+	// return a message value parsed as an 'x,y,z' vector, or a fallback if the key is absent
+	static vec3 vectorValue(const message &m, const std::string &key, const vec3 &fallback) {
+		auto found = m.find(key);
+		if (found == m.end()) {
+			return fallback;
+		}
+		vec3 result;
+		std::istringstream in(found->second);
+		char comma;
+		if (!(in >> result[0] >> comma >> result[1] >> comma >> result[2])) {
+			throw std::invalid_argument("malformed vector " + key);
+		}
+		return result;
+	}
+
+	// split 'key=value' lines into a message
+	static message parseMessage(const std::string &text) {
+		message result;
+		std::istringstream in(text);
+		std::string line;
+		while (std::getline(in, line)) {
+			auto separator = line.find('=');
+			if (separator != std::string::npos) {
+				result[line.substr(0, separator)] = line.substr(separator + 1);
+			}
+		}
+		return result;
+	}
+
+	// build a socket address for a path
+	static sockaddr_un socketAddress(const std::string &socket_path) {
+		sockaddr_un address{};
+		address.sun_family = AF_UNIX;
+		if (socket_path.size() >= sizeof(address.sun_path)) {
+			throw std::runtime_error("socket path too long " + socket_path);
+		}
+		std::copy(socket_path.begin(), socket_path.end(), address.sun_path);
+		return address;
+	}
+
+	// read or write exactly a number of bytes
+	static bool transfer(int fd, char *data, size_t size, bool reading) {
+		while (size > 0) {
+			auto bytes = reading ? read(fd, data, size) : write(fd, data, size);
+			// a signal arriving before any bytes moved is not a lost client
+			if (bytes < 0 && errno == EINTR) {
+				continue;
+			}
+			if (bytes <= 0) {
+				return false;
+			}
+			data += bytes;
+			size -= static_cast<size_t>(bytes);
+		}
+		return true;
+	}
+
+	// read one length-prefixed message
+	static bool readFrame(int fd, std::string &payload) {
+		unsigned char header[4];
+		if (!transfer(fd, reinterpret_cast<char *>(header), 4, true)) {
+			return false;
+		}
+		auto size = (uint32_t(header[0]) << 24) | (uint32_t(header[1]) << 16) | (uint32_t(header[2]) << 8) | header[3];
+		// requests are a few lines, anything larger is not a client of this protocol
+		if (size > (1u << 20)) {
+			return false;
+		}
+		payload.resize(size);
+		return transfer(fd, payload.data(), size, true);
+	}
+
+	// write one length-prefixed message
+	static bool writeFrame(int fd, std::string payload) {
+		auto size = static_cast<uint32_t>(payload.size());
+		unsigned char header[4] = { static_cast<unsigned char>(size >> 24), static_cast<unsigned char>(size >> 16),
+									static_cast<unsigned char>(size >> 8), static_cast<unsigned char>(size) };
+		return transfer(fd, reinterpret_cast<char *>(header), 4, false) && transfer(fd, payload.data(), payload.size(), false);
+	}
+
+};
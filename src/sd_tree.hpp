@@ -0,0 +1,303 @@
+#pragma once
+#include "aabb.hpp"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <numbers>
+#include <vector>
+
+// a class representing a learned distribution of the light arriving at points in a scene, used to guide path sampling
+// (a spatial-directional tree: a binary tree splitting the scene bounds in half along x, y and z in turn, each leaf
+// holding a quadtree histogram over directions, mapped to the unit square by cos(theta) and phi so every cell of
+// the square covers an equal solid angle; paths record the radiance they bring back into the leaves while a pass
+// renders, then refine() splits busy spatial leaves and subdivides the quadtree cells holding the most light)
+class sd_tree {
+public:
+
+	// a directional histogram, stored as a quadtree over the unit square
+	class direction_tree {
+	public:
+
+		// return true if the histogram has learned any light to sample
+		bool trained() const { return _total > 0; }
+
+		// sample a direction in proportion to the learned light
+		// returns:
+		//   a unit direction (only valid if trained() is true)
+		vec3 sample() const {
+			double x0 = 0, y0 = 0, size = 1;
+			uint32_t index = 0;
+			while (true) {
+				const auto &n = _nodes[index];
+				// pick a quadrant in proportion to its light
+				auto pick = randomDouble() * (n.sums[0] + n.sums[1] + n.sums[2] + n.sums[3]);
+				int q = 0;
+				while (q < 3 && (pick -= n.sums[q]) >= 0) {
+					++q;
+				}
+				// rounding can run past the last quadrant holding light
+				while (q > 0 && n.sums[q] <= 0) {
+					--q;
+				}
+				size *= 0.5;
+				x0 += (q & 1) * size;
+				y0 += (q >> 1) * size;
+				// sample uniformly within a leaf quadrant
+				if (n.children[q] == 0) {
+					return fromSquare(x0 + randomDouble() * size, y0 + randomDouble() * size);
+				}
+				index = n.children[q];
+			}
+		}
+
+		// return the solid angle probability density of sampling a direction
+		// parameters:
+		//   direction: a unit direction
+		double pdf(const vec3 &direction) const {
+			if (!trained()) {
+				return 0;
+			}
+			double x, y;
+			toSquare(direction, x, y);
+			auto density = 1.0;
+			uint32_t index = 0;
+			while (true) {
+				const auto &n = _nodes[index];
+				auto q = quadrant(x, y);
+				auto sum = n.sums[0] + n.sums[1] + n.sums[2] + n.sums[3];
+				if (n.sums[q] <= 0) {
+					return 0;
+				}
+				density *= 4 * n.sums[q] / sum;
+				if (n.children[q] == 0) {
+					// map the density on the unit square onto the sphere
+					return density / (4 * std::numbers::pi);
+				}
+				index = n.children[q];
+			}
+		}
+
+	private:
+
+		friend class sd_tree;
+
+		// a quadtree node, a child index of 0 marking a leaf quadrant
+		struct node {
+			std::array<uint32_t, 4> children{};	// child node of each quadrant
+			std::array<float, 4> sums{};			// light in each quadrant
+		};
+
+		std::vector<node> _nodes{ 1 };			// sampling histogram, from the last pass
+		float _total = 0;						// total light in the sampling histogram
+		std::vector<node> _building{ 1 };		// structure of the histogram being recorded
+		std::unique_ptr<std::atomic<float>[]> _energy{ new std::atomic<float>[4]() };	// light recorded into each quadrant of _building
+		std::atomic<size_t> _samples{ 0 };		// paths recorded this pass
+
+		// find the quadrant of a point in the unit square and rescale the point into it
+		static int quadrant(double &x, double &y) {
+			auto q = (x >= 0.5 ? 1 : 0) | (y >= 0.5 ? 2 : 0);
+			x = 2 * x - (q & 1);
+			y = 2 * y - (q >> 1);
+			return q;
+		}
+
+		// map a unit direction to the unit square
+		static void toSquare(const vec3 &d, double &x, double &y) {
+			x = std::clamp(0.5 * (d.z() + 1), 0.0, 1.0);
+			y = atan2(d.y(), d.x()) / (2 * std::numbers::pi);
+			y = y < 0 ? y + 1 : y;
+		}
+
+		// map a point in the unit square to a unit direction
+		static vec3 fromSquare(double x, double y) {
+			auto z = 2 * x - 1;
+			auto r = sqrt(fmax(0.0, 1 - z * z));
+			auto phi = 2 * std::numbers::pi * y;
+			return vec3(r * cos(phi), r * sin(phi), z);
+		}
+
+	};
+
+	int max_direction_depth = 20;			// deepest quadtree level
+	double subdivide_fraction = 0.01;		// quadtree cells holding more than this share of a leaf's light are split
+	size_t spatial_threshold = 4000;		// spatial leaves recording more paths than this in a pass are split
+	int max_spatial_depth = 48;				// deepest spatial tree level
+
+	// constructor to initialise an untrained tree
+	// parameters:
+	//   bounds: the box holding every point that will be looked up (points outside use the nearest leaf)
+	sd_tree(const aabb &bounds)
+		: _bounds(bounds) {
+		_spatial.push_back({ 0, 0 });
+		_leaves.push_back(std::make_unique<direction_tree>());
+	}
+
+	// return the directional histogram covering a point
+	const direction_tree &find(const point3 &p) const {
+		return *_leaves[_spatial[leafNode(p)].leaf];
+	}
+
+	// record the radiance a path brought back to a point from a direction (safe to call from many threads)
+	// parameters:
+	//   p: the point
+	//   direction: the unit direction the light arrived from
+	//   radiance: the luminance of the light divided by the probability density of sampling the direction
+	void record(const point3 &p, const vec3 &direction, double radiance) {
+		auto &leaf = *_leaves[_spatial[leafNode(p)].leaf];
+		leaf._samples.fetch_add(1, std::memory_order_relaxed);
+		if (!(radiance > 0) || !std::isfinite(radiance)) {
+			return;
+		}
+		double x, y;
+		direction_tree::toSquare(direction, x, y);
+		// add to the quadrant at every level down to the leaf
+		uint32_t index = 0;
+		while (true) {
+			auto q = direction_tree::quadrant(x, y);
+			auto &energy = leaf._energy[4 * index + q];
+			auto current = energy.load(std::memory_order_relaxed);
+			while (!energy.compare_exchange_weak(current, current + static_cast<float>(radiance), std::memory_order_relaxed)) { }
+			index = leaf._building[index].children[q];
+			if (index == 0) {
+				return;
+			}
+		}
+	}
+
+	// make the light recorded in the last pass the sampling distribution, and refine the tree for the next pass
+	// (not safe to call while paths are being recorded or sampled)
+	void refine() {
+		// find the current leaves and the depth of each
+		std::vector<std::pair<uint32_t, int>> leaves;
+		std::vector<std::pair<uint32_t, int>> stack{ { 0, 0 } };
+		while (!stack.empty()) {
+			auto [index, depth] = stack.back();
+			stack.pop_back();
+			if (_spatial[index].child == 0) {
+				leaves.emplace_back(index, depth);
+			} else {
+				stack.emplace_back(_spatial[index].child, depth + 1);
+				stack.emplace_back(_spatial[index].child + 1, depth + 1);
+			}
+		}
+		for (auto [index, depth] : leaves) {
+			auto &leaf = *_leaves[_spatial[index].leaf];
+			// the recorded light becomes the sampling histogram
+			leaf._nodes = leaf._building;
+			for (size_t n = 0; n < leaf._nodes.size(); ++n) {
+				for (int q = 0; q < 4; ++q) {
+					leaf._nodes[n].sums[q] = leaf._energy[4 * n + q].load(std::memory_order_relaxed);
+				}
+			}
+			auto &root = leaf._nodes.front().sums;
+			leaf._total = root[0] + root[1] + root[2] + root[3];
+			auto samples = leaf._samples.load(std::memory_order_relaxed);
+			// subdivide the histogram where the light is, and start recording afresh
+			leaf._building = subdivide(leaf);
+			leaf._energy.reset(new std::atomic<float>[4 * leaf._building.size()]());
+			leaf._samples = 0;
+			// split the leaf in space until each half would have recorded few enough paths
+			splitLeaf(index, depth, samples);
+		}
+	}
+
+private:
+
+	// a spatial tree node, splitting its box in half along the axis of its depth (x, y, z in turn)
+	struct spatial_node {
+		uint32_t child;							// first of two children, 0 for a leaf
+		uint32_t leaf;							// directional histogram of a leaf
+	};
+
+	aabb _bounds;							// box covered by the tree
+	std::vector<spatial_node> _spatial;		// spatial tree, root first
+	std::vector<std::unique_ptr<direction_tree>> _leaves;	// directional histograms of the spatial leaves
+
+	// find the spatial leaf covering a point
+	uint32_t leafNode(const point3 &p) const {
+		double lower[3] = { _bounds.x.min, _bounds.y.min, _bounds.z.min };
+		double upper[3] = { _bounds.x.max, _bounds.y.max, _bounds.z.max };
+		uint32_t index = 0;
+		for (int axis = 0; _spatial[index].child != 0; axis = (axis + 1) % 3) {
+			auto middle = 0.5 * (lower[axis] + upper[axis]);
+			if (p[axis] < middle) {
+				upper[axis] = middle;
+				index = _spatial[index].child;
+			} else {
+				lower[axis] = middle;
+				index = _spatial[index].child + 1;
+			}
+		}
+		return index;
+	}
+
+	// split a spatial leaf in two, repeatedly, while its share of the recorded paths exceeds the threshold
+	void splitLeaf(uint32_t index, int depth, size_t samples) {
+		if (samples <= spatial_threshold || depth >= max_spatial_depth) {
+			return;
+		}
+		// both halves start from copies of the leaf's histograms
+		auto child = static_cast<uint32_t>(_spatial.size());
+		const auto &source = *_leaves[_spatial[index].leaf];
+		for (int half = 0; half < 2; ++half) {
+			auto copy = std::make_unique<direction_tree>();
+			copy->_nodes = source._nodes;
+			copy->_total = source._total;
+			copy->_building = source._building;
+			copy->_energy.reset(new std::atomic<float>[4 * copy->_building.size()]());
+			_leaves.push_back(std::move(copy));
+		}
+		auto first_leaf = static_cast<uint32_t>(_leaves.size() - 2);
+		_spatial.push_back({ 0, first_leaf });
+		_spatial.push_back({ 0, first_leaf + 1 });
+		_spatial[index].child = child;
+		splitLeaf(child, depth + 1, samples / 2);
+		splitLeaf(child + 1, depth + 1, samples / 2);
+	}
+
+	// build the quadtree structure for the next pass, splitting every cell holding more than subdivide_fraction of
+	// the leaf's light (cells the last histogram did not split are assumed to hold their light evenly)
+	std::vector<direction_tree::node> subdivide(const direction_tree &leaf) const {
+		std::vector<direction_tree::node> result(1);
+		if (leaf._total <= 0) {
+			return result;
+		}
+		// new node, old node (or -1), depth and the share of the light in each quadrant
+		struct pending {
+			uint32_t index;
+			int64_t old_index;
+			int depth;
+			std::array<double, 4> shares;
+		};
+		auto shares = [&](uint32_t old_index) {
+			std::array<double, 4> s;
+			for (int q = 0; q < 4; ++q) {
+				s[q] = leaf._nodes[old_index].sums[q] / leaf._total;
+			}
+			return s;
+		};
+		std::vector<pending> stack{ { 0, 0, 1, shares(0) } };
+		while (!stack.empty()) {
+			auto next = stack.back();
+			stack.pop_back();
+			for (int q = 0; q < 4; ++q) {
+				if (next.shares[q] <= subdivide_fraction || next.depth >= max_direction_depth) {
+					continue;
+				}
+				auto child = static_cast<uint32_t>(result.size());
+				result[next.index].children[q] = child;
+				result.emplace_back();
+				// take the child shares from the old histogram where it was split this deep
+				auto old_child = next.old_index >= 0 ? leaf._nodes[next.old_index].children[q] : 0;
+				if (old_child != 0) {
+					stack.push_back({ child, old_child, next.depth + 1, shares(old_child) });
+				} else {
+					auto quarter = next.shares[q] / 4;
+					stack.push_back({ child, -1, next.depth + 1, { quarter, quarter, quarter, quarter } });
+				}
+			}
+		}
+		return result;
+	}
+
+};
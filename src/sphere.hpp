@@ -5,9 +5,24 @@
 class sphere : public hittable {
 public:
 
-	// constructor to initialise sphere with a centre, radius, and material
+	// constructor to initialise a stationary sphere with a centre, radius, and material
 	sphere(point3 _centre, double _radius, shared_ptr<material> _material)
-		: _centre(_centre), _radius(_radius), _material(_material) { }
+		: _centre(_centre), _radius(_radius), _material(_material), _is_moving(false) {
+		auto radius_vector = vec3(_radius, _radius, _radius);
+		_bbox = aabb(_centre - radius_vector, _centre + radius_vector);
+	}
+
+	// constructor to initialise a moving sphere, travelling linearly from centre0 at time 0 to centre1 at time 1
+	// (the bounding box covers times 0 to 1 only; the camera clamps its shutter interval to match)
+	sphere(point3 centre0, point3 centre1, double _radius, shared_ptr<material> _material)
+		: _centre(centre0), _radius(_radius), _material(_material), _is_moving(true) {
+		_centre_vector = centre1 - centre0;
+		// bound the volume swept by the sphere between both end points
+		auto radius_vector = vec3(_radius, _radius, _radius);
+		aabb box0(centre0 - radius_vector, centre0 + radius_vector);
+		aabb box1(centre1 - radius_vector, centre1 + radius_vector);
+		_bbox = aabb(box0, box1);
+	}
 
 	// check for ray / sphere intersection
 	// parameters:
@@ -17,8 +32,10 @@ public:
 	// returns:
 	//   true if an intersection matched else false
 	bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+		// calculate the sphere centre at the time the ray was cast
+		auto centre = _is_moving ? centreAt(r.time()) : _centre;
 		// calculate vector from ray origin to sphere centre
-		vec3 oc = r.origin() - _centre;
+		vec3 oc = r.origin() - centre;
 		// coefficients for ray-sphere intersection
 		auto a = r.direction().lengthSquared();
 		auto half_b = dot(oc, r.direction());
@@ -44,17 +61,57 @@ public:
  		// update hit_record
 		rec.distance = root;
 		rec.point = r.at(rec.distance);
-		auto outward_normal = (rec.point - _centre) / _radius;
+		auto outward_normal = (rec.point - centre) / _radius;
 		rec.setFaceNormal(r, outward_normal);
+		getSphereUV(outward_normal, rec.u, rec.v);
 		rec.material = _material;
 		// intersection found
 		return true;
 	}
 
+	// return the box enclosing the sphere (over its whole path when moving)
+	aabb boundingBox() const override { return _bbox; }
+
+	// return the centre at time 0
+	point3 startCentre() const { return _centre; }
+
+	// return the displacement of the centre from time 0 to time 1 (zero when stationary)
+	vec3 displacement() const { return _is_moving ? _centre_vector : vec3(0, 0, 0); }
+
+	// return the radius
+	double radius() const { return _radius; }
+
+	// return the material
+	shared_ptr<material> surface() const { return _material; }
+
+	// calculate texture coordinates of a point on the unit sphere
+	// parameters:
+	//   p: the point on the unit sphere centred at the origin
+	//   u: set to the angle around the y axis from x = -1, mapped to [0, 1]
+	//   v: set to the angle from y = -1 to y = +1, mapped to [0, 1]
+	static void getSphereUV(const point3 &p, double &u, double &v) {
+		auto theta = acos(-p.y());
+		auto phi = atan2(-p.z(), p.x()) + std::numbers::pi;
+		u = phi / (2 * std::numbers::pi);
+		v = theta / std::numbers::pi;
+	}
+
 private:
 
 	point3 _centre;							// sphere centre
 	double _radius;							// sphere radius
 	shared_ptr<material> _material;			// sphere material
+	bool _is_moving;						// sphere moves during the shutter interval
+	vec3 _centre_vector;					// displacement of the centre from time 0 to time 1
+	aabb _bbox;								// box enclosing the sphere
+
+	// calculate the centre of a moving sphere at a given time
+	// parameters:
+	//   time: the time (0 at the start position, 1 at the end position)
+	// returns:
+	//   the centre position
+	point3 centreAt(double time) const {
+		return _centre + time * _centre_vector;
+	}
 
 };
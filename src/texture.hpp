@@ -0,0 +1,76 @@
+#pragma once
+#include "colour.hpp"
+#include "point3.hpp"
+
+// an abstract class representing a colour that varies over a surface
+class texture {
+public:
+
+	// return the texture colour at a surface point
+	// parameters:
+	//   u, v: the surface texture coordinates
+	//   p: the position of the point
+	// returns:
+	//   the colour (linear)
+	virtual colour value(double u, double v, const point3 &p) const = 0;
+
+	// destructor to ensure cleanup in derived classes
+	virtual ~texture() = default;
+
+};
+
+// a derived class representing a texture with a single constant colour
+class solid_colour : public texture {
+public:
+
+	// constructor to initialise the texture colour
+	// parameters:
+	//   albedo: the colour
+	solid_colour(const colour &albedo) : _albedo(albedo) { }
+
+	// constructor to initialise the texture colour from components
+	solid_colour(double red, double green, double blue) : solid_colour(colour(red, green, blue)) { }
+
+	// return the constant colour
+	colour value(double, double, const point3 &) const override {
+		return _albedo;
+	}
+
+private:
+
+	colour _albedo;				// the constant colour
+
+};
+
+// a derived class representing a 3d checker pattern alternating between two textures
+class checker_texture : public texture {
+public:
+
+	// constructor to initialise the checker pattern
+	// parameters:
+	//   scale: the size of each checker cell in world units
+	//   even: texture of even cells
+	//   odd: texture of odd cells
+	checker_texture(double scale, shared_ptr<texture> even, shared_ptr<texture> odd)
+		: _inverse_scale(1.0 / scale), _even(even), _odd(odd) { }
+
+	// constructor to initialise the checker pattern with two solid colours
+	checker_texture(double scale, const colour &even, const colour &odd)
+		: checker_texture(scale, make_shared<solid_colour>(even), make_shared<solid_colour>(odd)) { }
+
+	// return the colour of the cell containing the point
+	colour value(double u, double v, const point3 &p) const override {
+		auto x = static_cast<int>(std::floor(_inverse_scale * p.x()));
+		auto y = static_cast<int>(std::floor(_inverse_scale * p.y()));
+		auto z = static_cast<int>(std::floor(_inverse_scale * p.z()));
+		auto is_even = (x + y + z) % 2 == 0;
+		return is_even ? _even->value(u, v, p) : _odd->value(u, v, p);
+	}
+
+private:
+
+	double _inverse_scale;				// inverse of the checker cell size
+	shared_ptr<texture> _even;			// texture of even cells
+	shared_ptr<texture> _odd;			// texture of odd cells
+
+};
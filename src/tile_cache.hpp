@@ -0,0 +1,25 @@
+#pragma once
+#include "lru_cache.hpp"
+#include <cstdint>
+#include <vector>
+
+// weighs a cached texture tile by its pixel bytes
+struct tile_bytes {
+	size_t operator()(const shared_ptr<const std::vector<uint8_t>> &data) const { return data->size(); }
+};
+
+// a class representing a bounded-memory, least recently used cache of texture tiles shared by many textures
+// (get takes a key unique to the tile across every texture using the cache and a function reading the tile from
+// disk; size is the number of tile bytes currently cached)
+class tile_cache : public lru_cache<shared_ptr<const std::vector<uint8_t>>, tile_bytes> {
+public:
+
+	// tile pixel data, kept alive by any lookup still using it after eviction
+	using tile = shared_ptr<const std::vector<uint8_t>>;
+
+	// constructor to initialise the cache
+	// parameters:
+	//   capacity_bytes: the maximum number of tile bytes held at once
+	tile_cache(size_t capacity_bytes) : lru_cache(capacity_bytes) { }
+
+};
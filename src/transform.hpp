@@ -0,0 +1,114 @@
+#pragma once
+#include "point3.hpp"
+
+// a class representing an affine transform (a 3x3 linear part followed by a translation)
+class transform {
+public:
+
+	double m[3][3];			// linear part (rotation, scale and shear), row major
+	vec3 t;					// translation
+
+	// default constructor (the identity transform)
+	transform()
+		: m{ { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } } { }
+
+	// return a transform that moves points by an offset
+	// parameters:
+	//   offset: the translation
+	static transform translation(const vec3 &offset) {
+		transform result;
+		result.t = offset;
+		return result;
+	}
+
+	// return a transform that scales about the origin
+	// parameters:
+	//   factors: the scale factor along each axis
+	static transform scaling(const vec3 &factors) {
+		transform result;
+		for (int i = 0; i < 3; ++i) {
+			result.m[i][i] = factors[i];
+		}
+		return result;
+	}
+
+	// return a transform that rotates about an axis through the origin
+	// parameters:
+	//   axis: the axis of rotation
+	//   degrees: the rotation angle in degrees (counter-clockwise looking down the axis)
+	static transform rotation(const vec3 &axis, double degrees) {
+		// rodrigues' rotation formula
+		auto a = unitVector(axis);
+		auto radians = degreesToRadians(degrees);
+		auto c = cos(radians);
+		auto s = sin(radians);
+		auto k = 1 - c;
+		transform result;
+		result.m[0][0] = c + a[0] * a[0] * k;
+		result.m[0][1] = a[0] * a[1] * k - a[2] * s;
+		result.m[0][2] = a[0] * a[2] * k + a[1] * s;
+		result.m[1][0] = a[1] * a[0] * k + a[2] * s;
+		result.m[1][1] = c + a[1] * a[1] * k;
+		result.m[1][2] = a[1] * a[2] * k - a[0] * s;
+		result.m[2][0] = a[2] * a[0] * k - a[1] * s;
+		result.m[2][1] = a[2] * a[1] * k + a[0] * s;
+		result.m[2][2] = c + a[2] * a[2] * k;
+		return result;
+	}
+
+	// transform a point (linear part and translation)
+	point3 point(const point3 &p) const {
+		return vector(p) + t;
+	}
+
+	// transform a direction vector (linear part only)
+	vec3 vector(const vec3 &v) const {
+		return vec3(m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+					m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+					m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+	}
+
+	// transform a direction by the transpose of the linear part
+	// (called on an inverse transform, this maps surface normals into the forward space)
+	vec3 transposedVector(const vec3 &v) const {
+		return vec3(m[0][0] * v[0] + m[1][0] * v[1] + m[2][0] * v[2],
+					m[0][1] * v[0] + m[1][1] * v[1] + m[2][1] * v[2],
+					m[0][2] * v[0] + m[1][2] * v[1] + m[2][2] * v[2]);
+	}
+
+	// return the inverse transform
+	// (the linear part must be invertible, eg. no zero scale factors)
+	transform inverse() const {
+		// invert the linear part using the adjugate
+		auto determinant = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+						 - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+						 + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+		auto inverse_determinant = 1 / determinant;
+		transform result;
+		result.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inverse_determinant;
+		result.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inverse_determinant;
+		result.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inverse_determinant;
+		result.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inverse_determinant;
+		result.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inverse_determinant;
+		result.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inverse_determinant;
+		result.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inverse_determinant;
+		result.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inverse_determinant;
+		result.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inverse_determinant;
+		// undo the translation in the inverted space
+		result.t = -result.vector(t);
+		return result;
+	}
+
+};
+
+// compose two transforms (the result applies b first, then a)
+inline transform operator*(const transform &a, const transform &b) {
+	transform result;
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 3; ++j) {
+			result.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+		}
+	}
+	result.t = a.point(b.t);
+	return result;
+}
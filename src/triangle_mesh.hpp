@@ -0,0 +1,230 @@
+#pragma once
+#include "flat_bvh.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// encode a unit normal into 32 bits using an octahedral mapping (two 16-bit signed components)
+// parameters:
+//   n: the unit normal
+// returns:
+//   the packed normal
+inline uint32_t encodeNormal(const vec3 &n) {
+	// project onto the octahedron |x| + |y| + |z| = 1
+	auto l1 = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+	auto x = n[0] / l1;
+	auto y = n[1] / l1;
+	// fold the lower hemisphere over the upper one
+	if (n[2] < 0) {
+		auto fx = (1 - fabs(y)) * (x >= 0 ? 1.0 : -1.0);
+		auto fy = (1 - fabs(x)) * (y >= 0 ? 1.0 : -1.0);
+		x = fx;
+		y = fy;
+	}
+	// quantise each component to a signed 16-bit value
+	auto qx = static_cast<int16_t>(round(std::clamp(x, -1.0, 1.0) * 32767.0));
+	auto qy = static_cast<int16_t>(round(std::clamp(y, -1.0, 1.0) * 32767.0));
+	return (static_cast<uint32_t>(static_cast<uint16_t>(qx)) << 16) | static_cast<uint16_t>(qy);
+}
+
+// decode a normal packed by encodeNormal
+// parameters:
+//   packed: the packed normal
+// returns:
+//   the unit normal
+inline vec3 decodeNormal(uint32_t packed) {
+	auto x = static_cast<int16_t>(packed >> 16) / 32767.0;
+	auto y = static_cast<int16_t>(packed & 0xffff) / 32767.0;
+	auto z = 1 - fabs(x) - fabs(y);
+	// unfold the lower hemisphere
+	if (z < 0) {
+		auto fx = (1 - fabs(y)) * (x >= 0 ? 1.0 : -1.0);
+		auto fy = (1 - fabs(x)) * (y >= 0 ? 1.0 : -1.0);
+		x = fx;
+		y = fy;
+	}
+	return unitVector(vec3(x, y, z));
+}
+
+// a class representing a triangle mesh stored as shared vertices and an index buffer, with its own bvh
+class triangle_mesh : public hittable {
+public:
+
+	// constructor to initialise the mesh and build its hierarchy
+	// parameters:
+	//   positions: vertex positions (three floats per vertex)
+	//   indices: vertex indices (three per triangle, counter-clockwise seen from the front)
+	//   material: the material of the whole mesh
+	//   smooth: interpolate quantised vertex normals rather than using flat face normals
+	triangle_mesh(std::vector<float> positions, std::vector<uint32_t> indices, shared_ptr<material> material, bool smooth = false)
+		: _positions(std::move(positions)), _indices(std::move(indices)), _material(material) {
+		if (smooth) {
+			computeVertexNormals();
+		}
+		buildHierarchy();
+	}
+
+	// check for ray / mesh intersection by walking the mesh hierarchy
+	// parameters:
+	//   r: the ray
+	//	 ray_t: an interval representing the range of intersection values
+	//   rec: the record containing intersection information
+	// returns:
+	//   true if an intersection matched else false
+	bool hit(const ray &r, interval ray_t, hit_record &rec) const override {
+		auto origin = r.origin();
+		auto direction = r.direction();
+		// placeholders for hit detection
+		uint32_t hit_triangle = 0;
+		double hit_b1 = 0, hit_b2 = 0;
+		// test each triangle of the leaves the ray reaches, shrinking the interval on a hit
+		auto hit_anything = _bvh.traverse(r, ray_t, [&](const flat_bvh::node &leaf, interval &leaf_t) {
+			auto hit_leaf = false;
+			for (uint32_t t = leaf.offset; t < leaf.offset + leaf.count; ++t) {
+				double distance, b1, b2;
+				if (hitTriangle(t, origin, direction, leaf_t, distance, b1, b2)) {
+					hit_leaf = true;
+					leaf_t.max = distance;
+					hit_triangle = t;
+					hit_b1 = b1;
+					hit_b2 = b2;
+				}
+			}
+			return hit_leaf;
+		});
+		if (!hit_anything) {
+			return false;
+		}
+		// update hit_record
+		rec.distance = ray_t.max;
+		rec.point = r.at(rec.distance);
+		rec.setFaceNormal(r, shadingNormal(hit_triangle, hit_b1, hit_b2));
+		// the mesh has no texture coordinate buffer, so the barycentric coordinates are used
+		rec.u = hit_b1;
+		rec.v = hit_b2;
+		rec.material = _material;
+		// intersection found
+		return true;
+	}
+
+	// return the box enclosing the mesh
+	aabb boundingBox() const override { return _bbox; }
+
+	// return the number of triangles in the mesh
+	size_t triangleCount() const { return _indices.size() / 3; }
+
+	// return the number of vertices in the mesh
+	size_t vertexCount() const { return _positions.size() / 3; }
+
+private:
+
+	std::vector<float> _positions;			// vertex positions (three per vertex)
+	std::vector<uint32_t> _indices;			// vertex indices (three per triangle, ordered by leaf)
+	std::vector<uint32_t> _normals;			// packed vertex normals (empty for flat shading)
+	flat_bvh _bvh;							// hierarchy over the triangles
+	shared_ptr<material> _material;			// mesh material
+	aabb _bbox;								// box enclosing the mesh
+
+	// return the position of a vertex
+	point3 vertex(uint32_t index) const {
+		return point3(_positions[3 * index], _positions[3 * index + 1], _positions[3 * index + 2]);
+	}
+
+	// check for ray / triangle intersection (möller-trumbore)
+	// parameters:
+	//   t: the triangle index
+	//   origin, direction: the ray
+	//   ray_t: an interval representing the range of intersection values
+	//   distance, b1, b2: set to the hit distance and barycentric coordinates on a hit
+	// returns:
+	//   true if an intersection matched else false
+	bool hitTriangle(uint32_t t, const point3 &origin, const vec3 &direction, const interval &ray_t,
+					 double &distance, double &b1, double &b2) const {
+		auto p0 = vertex(_indices[3 * t]);
+		auto edge1 = vertex(_indices[3 * t + 1]) - p0;
+		auto edge2 = vertex(_indices[3 * t + 2]) - p0;
+		auto p = cross(direction, edge2);
+		auto determinant = dot(edge1, p);
+		// ray parallel to the triangle plane
+		if (fabs(determinant) < 1e-12) {
+			return false;
+		}
+		auto inverse_determinant = 1 / determinant;
+		auto s = origin - p0;
+		b1 = dot(s, p) * inverse_determinant;
+		if (b1 < 0 || b1 > 1) {
+			return false;
+		}
+		auto q = cross(s, edge1);
+		b2 = dot(direction, q) * inverse_determinant;
+		if (b2 < 0 || b1 + b2 > 1) {
+			return false;
+		}
+		distance = dot(edge2, q) * inverse_determinant;
+		return ray_t.surrounds(distance);
+	}
+
+	// calculate the outward shading normal at a point on a triangle
+	// parameters:
+	//   t: the triangle index
+	//   b1, b2: barycentric coordinates of the point
+	vec3 shadingNormal(uint32_t t, double b1, double b2) const {
+		if (!_normals.empty()) {
+			// interpolate the vertex normals
+			auto n = (1 - b1 - b2) * decodeNormal(_normals[_indices[3 * t]])
+				   + b1 * decodeNormal(_normals[_indices[3 * t + 1]])
+				   + b2 * decodeNormal(_normals[_indices[3 * t + 2]]);
+			return unitVector(n);
+		}
+		// flat face normal
+		auto p0 = vertex(_indices[3 * t]);
+		return unitVector(cross(vertex(_indices[3 * t + 1]) - p0, vertex(_indices[3 * t + 2]) - p0));
+	}
+
+	// calculate smooth vertex normals as area-weighted averages of adjacent face normals
+	void computeVertexNormals() {
+		std::vector<vec3> sums(vertexCount());
+		for (size_t t = 0; t < triangleCount(); ++t) {
+			auto p0 = vertex(_indices[3 * t]);
+			auto n = cross(vertex(_indices[3 * t + 1]) - p0, vertex(_indices[3 * t + 2]) - p0);
+			for (int k = 0; k < 3; ++k) {
+				sums[_indices[3 * t + k]] += n;
+			}
+		}
+		_normals.resize(sums.size());
+		for (size_t v = 0; v < sums.size(); ++v) {
+			_normals[v] = sums[v].nearZero() ? encodeNormal(vec3(0, 0, 1)) : encodeNormal(unitVector(sums[v]));
+		}
+	}
+
+	// build the hierarchy and reorder the index buffer so each leaf covers a contiguous range
+	void buildHierarchy() {
+		auto triangles = static_cast<uint32_t>(triangleCount());
+		if (triangles == 0) {
+			return;
+		}
+		// precompute triangle boxes and centres
+		std::vector<flat_bvh::item> items(triangles);
+		for (uint32_t t = 0; t < triangles; ++t) {
+			auto &item = items[t];
+			item.index = t;
+			for (int a = 0; a < 3; ++a) {
+				auto v0 = _positions[3 * _indices[3 * t] + a];
+				auto v1 = _positions[3 * _indices[3 * t + 1] + a];
+				auto v2 = _positions[3 * _indices[3 * t + 2] + a];
+				item.min[a] = std::min({ v0, v1, v2 });
+				item.max[a] = std::max({ v0, v1, v2 });
+				item.centre[a] = 0.5f * (item.min[a] + item.max[a]);
+			}
+		}
+		_bvh.build(items);
+		_bbox = _bvh.bounds().pad();
+		// apply the leaf order to the index buffer
+		std::vector<uint32_t> reordered(_indices.size());
+		for (uint32_t t = 0; t < triangles; ++t) {
+			std::copy_n(&_indices[3 * items[t].index], 3, &reordered[3 * t]);
+		}
+		_indices.swap(reordered);
+	}
+
+};